@@ -3,7 +3,7 @@ CXX ?= g++
 
 # flags
 CXXFLAGS += -O3 -ffast-math -Wall -fPIC -DPIC $(shell pkg-config --cflags fftw3f) -I. -I../Shared_files
-LDFLAGS += -shared -Wl,-O3 -Wl,--as-needed -Wl,--no-undefined -Wl,--strip-all $(shell pkg-config --libs fftw3f) -larmadillo -lm
+LDFLAGS += -shared -Wl,-O3 -Wl,--as-needed -Wl,--no-undefined -Wl,--strip-all $(shell pkg-config --libs fftw3f) -larmadillo -lm -pthread
 
 ifneq ($(NOOPT),true)
 CXXFLAGS += -mtune=generic -msse -msse2 -mfpmath=sse
@@ -30,9 +30,16 @@ SHARED_DIR = ../Shared_files
 SRC = $(wildcard src/*.cpp) \
 	$(SHARED_DIR)/PitchShifterClasses.cpp \
 	$(SHARED_DIR)/GainClass.cpp \
-	$(SHARED_DIR)/angle.cpp \
-	$(SHARED_DIR)/Exp.cpp \
-	$(SHARED_DIR)/window.cpp
+	$(SHARED_DIR)/DecimatorClass.cpp \
+	$(SHARED_DIR)/window.cpp \
+	$(SHARED_DIR)/peaks.cpp \
+	$(SHARED_DIR)/phase.cpp \
+	$(SHARED_DIR)/OscillatorBank.cpp \
+	$(SHARED_DIR)/Resampler.cpp \
+	$(SHARED_DIR)/planner.cpp \
+	$(SHARED_DIR)/Arena.cpp \
+	$(SHARED_DIR)/FlightRecorder.cpp \
+	$(SHARED_DIR)/BinPool.cpp
 OBJ = $(SRC:.cpp=.o)
 
 ## rules
@@ -42,12 +49,48 @@ $(PLUGIN_SO): $(OBJ)
 	$(CXX) $^ $(LDFLAGS) -o $@
 
 clean:
-	$(RM) *.so src/*.o
+	$(RM) *.so src/*.o $(PLUGIN)-replay $(PLUGIN)-stress $(PLUGIN)-evaluate $(PLUGIN)-loadtime $(PLUGIN)-inplace $(PLUGIN)-bench
 
 install: all
 	mkdir -p $(INSTALLATION_PATH)
 	cp -rL $(PLUGIN_SO) ttl/* src/modgui $(INSTALLATION_PATH)
 	cp $(SHARED_DIR)/harmonizer.wisdom.raspberrypi4 $(INSTALLATION_PATH)/harmonizer.wisdom
 
+# offline driver for flight recorder dumps
+replay: $(PLUGIN)-replay
+
+$(PLUGIN)-replay: tools/replay.cpp
+	$(CXX) $< -O2 -Wall -I$(SHARED_DIR) -ldl -o $@
+
+# many instances across threads, changing their settings as they run
+stress: $(PLUGIN)-stress
+
+$(PLUGIN)-stress: tools/stress.cpp tools/host.h
+	$(CXX) $< -O2 -Wall -ldl -pthread -o $@
+
+# every frame length, window, synthesis and interpolation measured on reference signals, with the engine built in
+evaluate: $(PLUGIN)-evaluate
+
+$(PLUGIN)-evaluate: tools/evaluate.cpp $(filter $(SHARED_DIR)/%,$(SRC))
+	$(CXX) $^ $(CXXFLAGS) $(shell pkg-config --libs fftw3f) -larmadillo -lm -pthread -o $@
+
+# time per hop at Insane with the bins split over 1 to 4 threads, with the engine built in
+bench: $(PLUGIN)-bench
+
+$(PLUGIN)-bench: tools/bench.cpp $(filter $(SHARED_DIR)/%,$(SRC))
+	$(CXX) $^ $(CXXFLAGS) $(shell pkg-config --libs fftw3f) -larmadillo -lm -pthread -o $@
+
+# time of instantiate and activate, with and without the worker, and of building every Fidelity
+loadtime: $(PLUGIN)-loadtime
+
+$(PLUGIN)-loadtime: tools/loadtime.cpp tools/host.h
+	$(CXX) $< -O2 -Wall -ldl -pthread -o $@
+
+# the same session with separate buffers and with the input buffer as output, compared bit for bit
+inplace: $(PLUGIN)-inplace
+
+$(PLUGIN)-inplace: tools/inplace.cpp tools/host.h
+	$(CXX) $< -O2 -Wall -ldl -pthread -o $@
+
 %.o: %.cpp
 	$(CXX) $< $(CXXFLAGS) -c -o $@
@@ -1,19 +1,24 @@
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
 #include <cmath>
 #include <algorithm>
+#include <vector>
 #include "PitchShifterClasses.h"
 #include "GainClass.h"
+#include "DecimatorClass.h"
+#include "FlightRecorder.h"
+#include <lv2/lv2plug.in/ns/ext/atom/util.h>
+#include <lv2/lv2plug.in/ns/ext/midi/midi.h>
+#include <lv2/lv2plug.in/ns/ext/urid/urid.h>
+#include <lv2/lv2plug.in/ns/ext/worker/worker.h>
 
 /**********************************************************************************************************************************************************/
 
 #define PLUGIN_URI "https://github.com/theKAOSSphere/ricochet"
-#define FIDELITY0 6,3,2,1
-#define FIDELITY1 12,6,3,2
-#define FIDELITY2 16,8,4,2
-#define FIDELITY3 20,10,5,3
-#define FIDELITY4 32,16,8,4
-#define FIDELITY5 48,24,12,6
-enum {IN, OUT, TRIGGER, MODE, INTERVAL, DIRECTION, SHIFT_TIME, RETURN_TIME, CLEAN, WET_GAIN, FIDELITY, TRUE_BYPASS, PLUGIN_PORT_COUNT};
+enum {IN, OUT, TRIGGER, MODE, INTERVAL, DIRECTION, SHIFT_TIME, RETURN_TIME, CLEAN, WET_GAIN, FIDELITY, TRUE_BYPASS, DECIMATE, LATENCY, WINDOW, SYNTHESIS, INTERPOLATION, CONTROL, TRANSIENTS, RECORDER, SPIKE_BUDGET, DUMP, THREADS, PLUGIN_PORT_COUNT};
 
 namespace
 {
@@ -35,7 +40,48 @@ namespace
     };
 
     constexpr size_t kIntervalChoiceCount = sizeof(kIntervalChoices) / sizeof(kIntervalChoices[0]);
+
+    // Frame length in milliseconds of each Fidelity setting, at 48 kHz these are the
+    // 384/768/1024/2048/2560/3072 sample frames, from the
+    // Pareto front of tools/evaluate.cpp over blocks of 64, 128 and 256 samples
+    static const double kFidelityFrameMs[] = {
+        8.0,     // Lo-Fi
+        16.0,    // Medium
+        21.333,  // High
+        42.667,  // Hi-Fi
+        53.333,  // Ultra
+        64.0     // Insane
+    };
+
+    constexpr int kFidelityCount = sizeof(kFidelityFrameMs) / sizeof(kFidelityFrameMs[0]);
+    constexpr int kDefaultFidelity = 1;
     constexpr double kTimeEpsilon = 1e-9;
+
+    // Integral from 0 to x of a pitch held within [lo, hi], with lo <= 0 <= hi
+    inline double ClampedIntegral(double x, double lo, double hi)
+    {
+        double c = std::max(lo, std::min(x, hi));
+        return 0.5 * c * c + c * (x - c);
+    }
+
+    // Requests sent to the worker, the reply to WORK_ALLOCATE carries the new recorder, the one to
+    // WORK_CONSTRUCT tells the audio thread the engine is built and the one to WORK_THREADS carries the new
+    // helper pool. WORK_RELEASE hands back the pool it replaced, and gets no reply
+    enum {WORK_ALLOCATE, WORK_DUMP, WORK_CONSTRUCT, WORK_THREADS, WORK_RELEASE};
+
+    struct WorkMessage
+    {
+        uint32_t type;
+        uint32_t n_samples;
+        FlightRecorder *recorder;
+        int nBuffers; // Configuration of WORK_CONSTRUCT, nBuffers is 0 in the reply if it could not be built
+        int factor;
+        int window;
+        BinPool *pool; // WORK_THREADS and WORK_RELEASE
+        int threads;
+        int policy; // Scheduling of the audio thread, the helpers take it on
+        int priority;
+    };
 }
 
 /**********************************************************************************************************************************************************/
@@ -43,24 +89,53 @@ namespace
 class Ricochet
 {
 public:
-    Ricochet(uint32_t n_samples, int nBuffers, double samplerate, const std::string& wfile)
+    // The engine is not built here: it is left to the worker, or to Prepare when there is none
+    Ricochet(double samplerate, const std::string& wfile)
     {
         wisdomFile = wfile;
-        Construct(n_samples, nBuffers, samplerate, wfile.c_str());
+        SampleRate = samplerate;
+        ready = false;
+        construct_requested = false;
+        obja = NULL;
+        objs = NULL;
+        objg = NULL;
+        objd = NULL;
     }
 
-    ~Ricochet(){Destruct();}
+    ~Ricochet(){Destruct(); delete recorder; delete pool;}
     
-    void Construct(uint32_t n_samples, int nBuffers, double samplerate, const char* wisdomFile)
+    void Construct(uint32_t n_samples, int nBuffers, int factor, int window, double samplerate, const char* wisdomFile)
     {
         this->nBuffers = nBuffers;
+        this->factor = factor;
         SampleRate = samplerate;
 
-        obja = new PSAnalysis(n_samples, nBuffers, wisdomFile);
-        objs = new PSSinthesis(obja, wisdomFile);
-        objg = new GainClass(n_samples);
+        // The vocoder runs at SampleRate/factor on blocks of n_samples/factor
+        uint32_t hop = n_samples / factor;
+
+        // All the buffers of the instance live in one block, kept across Realloc unless it has to grow
+        arena.Reserve(ArenaSize(n_samples, nBuffers, factor, window));
 
-        last_out = new float[n_samples];
+        if (factor > 1)
+        {
+            objd = new DecimatorClass(n_samples, factor, MaxDelay(hop, nBuffers) * factor, &arena);
+            low_in = arena.Take<float>(hop);
+        }
+        else
+        {
+            objd = NULL;
+            low_in = NULL;
+            low_out = NULL;
+        }
+
+        obja = new PSAnalysis(hop, nBuffers, window, &arena, wisdomFile);
+        objs = new PSSinthesis(obja, &arena, wisdomFile);
+        objg = new GainClass(hop);
+
+        if (factor > 1)
+            low_out = arena.Take<float>(hop);
+
+        staged_in = arena.Take<float>(n_samples);
         
         // Variables to handle crossfading during true bypass
         fade_progress = 0.0;
@@ -73,6 +148,7 @@ public:
         ramp_samples_remaining = 0.0;
         ramp_step = 0.0;
         ramp_active_time = 0.0;
+        ramp_span = 0.0;
         latched_on = false;
         prev_trigger_state = false;
         last_mode_was_latch = false;
@@ -84,45 +160,102 @@ public:
         delete obja;
         delete objs;
         delete objg;
-        delete[] last_out;
+        delete objd;
+        obja = NULL;
+        objs = NULL;
+        objg = NULL;
+        objd = NULL;
     }
     
-    void Realloc(uint32_t n_samples, int nBuffers)
+    void Realloc(uint32_t n_samples, int nBuffers, int factor, int window)
     {
         Destruct();
-        Construct(n_samples, nBuffers, SampleRate, wisdomFile.c_str());
+        Construct(n_samples, nBuffers, factor, window, SampleRate, wisdomFile.c_str());
+    }
+
+    // Builds the engine outside of run() and marks it usable. Without a worker the engine is rebuilt in run(), so the
+    // arena is sized here for every setting at this block size and its halves, and is not allocated again there
+    void Prepare(uint32_t n_samples, int nBuffers, int factor, int window)
+    {
+        size_t bytes = 0;
+        for (uint32_t n = n_samples; n >= 16; n /= 2)
+            bytes = std::max(bytes, MaxArenaSize(n));
+        arena.Reserve(bytes);
+        Construct(n_samples, nBuffers, factor, window, SampleRate, wisdomFile.c_str());
+        Ready();
     }
 
-    void SetFidelity(int fidelity, uint32_t n_samples)
+    void Ready()
     {
-        int bufsize;
+        ready = true;
+        state_bytes = StateBytes();
+    }
+
+    // Buffers and decimation factor of a Fidelity setting, false if the setting is out of range
+    bool Configuration(int fidelity, bool decimate, uint32_t n_samples, int *bufsize, int *new_factor)
+    {
+        if (fidelity < 0 || fidelity >= kFidelityCount)
+            return false;
+
+        *new_factor = decimate ? DecimationFactor(SampleRate) : 1;
+        if (n_samples % *new_factor != 0)
+            *new_factor = 1;
+
+        *bufsize = nBuffersMs(n_samples / *new_factor, SampleRate / *new_factor, kFidelityFrameMs[fidelity]);
+        return true;
+    }
+
+    // True if the engine has to be rebuilt for these settings and block size
+    bool Reconfigure(int fidelity, bool decimate, int window, uint32_t n_samples, int *bufsize, int *new_factor)
+    {
+        if (!Configuration(fidelity, decimate, n_samples, bufsize, new_factor))
+            return false;
+
+        return nBuffers != *bufsize || obja->hopa != (int)(n_samples / *new_factor) || factor != *new_factor || obja->window != window;
+    }
 
-        switch (fidelity)
+    // Rebuilds the engine in run(), only when there is no worker to do it. The arena only grows for a block size
+    // Prepare did not size it for, if that fails the input is passed through from then on
+    void SetFidelity(int fidelity, bool decimate, int window, uint32_t n_samples)
+    {
+        int bufsize, new_factor;
+        if (!Reconfigure(fidelity, decimate, window, n_samples, &bufsize, &new_factor))
+            return;
+        try
+        {
+            Realloc(n_samples, bufsize, new_factor, window);
+        }
+        catch (const std::bad_alloc&)
         {
-            case 0: 
-                bufsize = nBuffersSW(n_samples,FIDELITY0);
-                break;
-            case 1:
-                bufsize = nBuffersSW(n_samples,FIDELITY1);
-                break;
-            case 2:
-                bufsize = nBuffersSW(n_samples,FIDELITY2);
-                break;
-            case 3:
-                bufsize = nBuffersSW(n_samples,FIDELITY3);
-                break;
-            case 4:
-                bufsize = nBuffersSW(n_samples,FIDELITY4);
-                break;
-            case 5:
-                bufsize = nBuffersSW(n_samples,FIDELITY5);
-                break;
-            default:
-                return;
+            Destruct();
+            ready = false;
         }
+    }
+
+    // Bytes of DSP memory of an instance, see the table in the README
+    static size_t ArenaSize(uint32_t n_samples, int nBuffers, int factor, int window)
+    {
+        uint32_t hop = n_samples / factor;
+        size_t bytes = PSAnalysis::ArenaSize(hop, nBuffers, window) + PSSinthesis::ArenaSize(hop, nBuffers) + Arena::Bytes<float>(n_samples);
+        if (factor > 1)
+            bytes += DecimatorClass::ArenaSize(n_samples, factor, MaxDelay(hop, nBuffers) * factor) + 2*Arena::Bytes<float>(hop);
+        return bytes;
+    }
 
-        if (nBuffers != bufsize || obja->hopa != (int)n_samples)
-            Realloc(n_samples, bufsize);
+    // Longest delay of the vocoder in its own samples, that of any synthesis mode and interpolation
+    static int MaxDelay(uint32_t hop, int nBuffers)
+    {
+        return hop * nBuffers + SINC_TAPS/2;
+    }
+
+    // Delay of the processed path in host samples: the delay of the synthesis mode, plus the
+    // decimation filters when they are in use
+    uint32_t Latency()
+    {
+        uint32_t latency = objs->Delay() * factor;
+        if (objd)
+            latency += 2 * objd->D;
+        return latency;
     }
 
     static LV2_Handle instantiate(const LV2_Descriptor* descriptor, double samplerate, const char* bundle_path, const LV2_Feature* const* features);
@@ -132,20 +265,104 @@ public:
     static void run(LV2_Handle instance, uint32_t n_samples);
     static void cleanup(LV2_Handle instance);
     static const void* extension_data(const char* uri);
-    double UpdateStep(bool trigger_active,
+    void UpdateTarget(bool trigger_active,
                       bool latch_mode,
                       double interval_control,
                       bool direction_up,
                       double shift_time,
-                      double return_time,
-                      uint32_t n_samples);
+                      double return_time);
+    double AdvanceRamp(uint32_t n_samples, double bend);
+    void ReadMidi(const uint8_t *msg);
+    double Control(uint32_t n_samples);
+    static void Process(LV2_Handle instance, uint32_t n_samples);
+    void Record(uint32_t n_samples);
+    size_t MaxArenaSize(uint32_t n_samples);
+    int Replay(const char *dump, const char *output);
+    static LV2_Worker_Status work(LV2_Handle instance, LV2_Worker_Respond_Function respond, LV2_Worker_Respond_Handle handle, uint32_t size, const void *data);
+    static LV2_Worker_Status work_response(LV2_Handle instance, uint32_t size, const void *data);
+    static int replay(void *instance, const char *dump, const char *output);
+
+    // Everything run() changes outside the arena, in the order a flight recorder checkpoint stores it
+    template <class F> void State(F field)
+    {
+        field(cont); field(current_s); field(ramp_position); field(ramp_target); field(ramp_samples_remaining);
+        field(ramp_step); field(ramp_active_time); field(ramp_span); field(latched_on); field(prev_trigger_state);
+        field(last_mode_was_latch); field(auto_add_dry); field(engaged); field(was_true_bypassing); field(fading_in);
+        field(fading_out); field(prev_engaged); field(prev_ramp_samples_remaining); field(fade_progress);
+        field(midi_notes); field(midi_sustain); field(midi_interval); field(midi_bend); field(prev_interval_port);
+        field(obja->transients); field(obja->energy); field(obja->hold); field(obja->Na); field(obja->resized); field(obja->reset);
+        field(objs->first); field(objs->synthesis); field(objs->npeaks); field(objs->frac); field(objs->resampler->quality);
+        field(objs->bank->count); field(objg->g); field(objg->g_1);
+        int none[2] = {0, 0};
+        field(objd ? objd->hpos : none[0]); field(objd ? objd->hblock : none[1]);
+    }
+
+    // The configuration of the engine comes first, a checkpoint is restored into an engine built the same way.
+    // Rounded to 8 bytes so what follows it in a dump stays aligned
+    size_t StateBytes()
+    {
+        size_t bytes = 4*sizeof(int);
+        State([&](auto &x) { bytes += sizeof(x); });
+        return (bytes + 7) & ~(size_t)7;
+    }
+
+    void SaveState(char *state)
+    {
+        int config[4] = {obja->hopa*factor, nBuffers, factor, obja->window};
+        memcpy(state, config, sizeof(config));
+        state += sizeof(config);
+        State([&](auto &x) { memcpy(state, &x, sizeof(x)); state += sizeof(x); });
+    }
+
+    bool LoadState(const char *state, const char *bytes, size_t used)
+    {
+        int config[4];
+        memcpy(config, state, sizeof(config));
+        state += sizeof(config);
+        if (obja->hopa*factor != config[0] || nBuffers != config[1] || factor != config[2] || obja->window != config[3])
+        {
+            // An engine that can't be built for the checkpoint leaves the instance without one, as in SetFidelity
+            try
+            {
+                Realloc(config[0], config[1], config[2], config[3]);
+            }
+            catch (const std::bad_alloc&)
+            {
+                Destruct();
+                ready = false;
+                return false;
+            }
+        }
+        if (arena.used != used)
+            return false;
+        memcpy(arena.base, bytes, used);
+        State([&](auto &x) { memcpy(&x, state, sizeof(x)); state += sizeof(x); });
+        return true;
+    }
+
     float *ports[PLUGIN_PORT_COUNT];
+    const LV2_Atom_Sequence *control;
+    LV2_URID midi_MidiEvent;
+    LV2_Worker_Schedule *schedule;
+    bool ready; // The engine is built, until then run() passes the input through
+    bool construct_requested;
+    FlightRecorder *recorder;
+    bool recorder_requested;
+    BinPool *pool; // Helper threads the bins of a hop are split across, NULL for one thread
+    int threads;
+    bool threads_requested;
+    bool prev_dump;
+    int dumps;
+    size_t state_bytes;
     
     PSAnalysis *obja;
     PSSinthesis *objs;
     GainClass *objg;
+    DecimatorClass *objd;
+    Arena arena;
 
     int nBuffers;
+    int factor;
     int cont;
     double SampleRate;
     std::string wisdomFile;
@@ -155,6 +372,7 @@ public:
     double ramp_samples_remaining;
     double ramp_step;
     double ramp_active_time;
+    double ramp_span;
     bool latched_on;
     bool prev_trigger_state;
     bool last_mode_was_latch;
@@ -164,10 +382,18 @@ public:
     bool fading_in;
     bool fading_out;
     bool prev_engaged;
-    float* last_out;
+    float* staged_in; // Input of the block kept for the crossfades when the host runs the plugin in place
+    float* low_in;
+    float* low_out;
     double prev_ramp_samples_remaining;
     double fade_progress;
     double fade_step;
+    // MIDI state, the trigger follows held notes and the sustain pedal
+    int midi_notes;
+    bool midi_sustain;
+    double midi_interval;
+    double midi_bend;
+    double prev_interval_port;
 };
 
 /**********************************************************************************************************************************************************/
@@ -195,8 +421,37 @@ LV2_Handle Ricochet::instantiate(const LV2_Descriptor* descriptor, double sample
 {
     std::string wisdomFile = bundle_path;
     wisdomFile += "/harmonizer.wisdom";
-    const uint32_t n_samples = GetBufferSize(features);
-    Ricochet *plugin = new Ricochet(n_samples, nBuffersSW(n_samples,FIDELITY1), samplerate, wisdomFile);
+    Ricochet *plugin = new Ricochet(samplerate, wisdomFile);
+
+    const LV2_URID_Map* uridMap = NULL;
+    plugin->schedule = NULL;
+    for (int i=0; features[i] != NULL; ++i)
+    {
+        if (strcmp(features[i]->URI, LV2_URID__map) == 0)
+            uridMap = (const LV2_URID_Map*)features[i]->data;
+        else if (strcmp(features[i]->URI, LV2_WORKER__schedule) == 0)
+            plugin->schedule = (LV2_Worker_Schedule*)features[i]->data;
+    }
+    plugin->control = NULL;
+    // The flight recorder is only allocated once it is switched on, and needs the worker to do so
+    plugin->recorder = NULL;
+    plugin->recorder_requested = false;
+    // Likewise the helper threads, without the worker the plugin stays on one thread
+    plugin->pool = NULL;
+    plugin->threads = 1;
+    plugin->threads_requested = false;
+    plugin->prev_dump = false;
+    plugin->dumps = 0;
+    plugin->state_bytes = 0;
+    // Planning the FFTs is what makes loading slow, with a worker it happens after the first run(). Without one
+    // the engine is built now, as run() can't wait for it
+    if (!plugin->schedule)
+    {
+        const uint32_t n_samples = GetBufferSize(features);
+        plugin->Prepare(n_samples, nBuffersMs(n_samples, samplerate, kFidelityFrameMs[kDefaultFidelity]), 1, HANN_WINDOW);
+    }
+    // Without a URID map no event can be recognised and the Control port is ignored
+    plugin->midi_MidiEvent = uridMap ? uridMap->map(uridMap->handle, LV2_MIDI__MidiEvent) : 0;
     return (LV2_Handle)plugin;
 }
 
@@ -221,9 +476,19 @@ void Ricochet::activate(LV2_Handle instance)
     plugin->fading_out = false;
     plugin->prev_engaged = false;
     plugin->prev_ramp_samples_remaining = 0.0;
+    plugin->midi_notes = 0;
+    plugin->midi_sustain = false;
+    plugin->midi_interval = -1.0;
+    plugin->midi_bend = 0.0;
+    plugin->prev_interval_port = -1.0;
+    plugin->fade_progress = 0.0;
+    // An engine still to be built by the worker comes up clear
+    if (!plugin->ready)
+        return;
     (plugin->objs)->ClearBuffers();
+    if (plugin->objd)
+        (plugin->objd)->Clear();
     plugin->cont = 0;
-    plugin->fade_progress = 0.0;
 }
 
 /**********************************************************************************************************************************************************/
@@ -236,7 +501,10 @@ void Ricochet::connect_port(LV2_Handle instance, uint32_t port, void *data)
 {
     Ricochet *plugin;
     plugin = (Ricochet *) instance;
-    plugin->ports[port] = (float*) data;
+    if (port == CONTROL)
+        plugin->control = (const LV2_Atom_Sequence*) data;
+    else
+        plugin->ports[port] = (float*) data;
 }
 
 /**********************************************************************************************************************************************************/
@@ -245,21 +513,159 @@ void Ricochet::run(LV2_Handle instance, uint32_t n_samples)
 {
     Ricochet *plugin = (Ricochet *) instance;
 
+    int fidelity = (int)(*(plugin->ports[FIDELITY])+0.5f);
+    bool decimate = (*(plugin->ports[DECIMATE]) >= 0.5f);
+    int window = (*(plugin->ports[WINDOW]) >= 0.5f) ? ASYMMETRIC_WINDOW : HANN_WINDOW;
+    WorkMessage msg = {WORK_CONSTRUCT, n_samples, NULL, 0, 1, window};
+
+    // A new Fidelity, Window, Decimate or block size is built by the worker the same way as the first engine
+    if (plugin->ready && plugin->schedule && plugin->Reconfigure(fidelity, decimate, window, n_samples, &msg.nBuffers, &msg.factor))
+    {
+        plugin->ready = false;
+        plugin->construct_requested = false;
+    }
+
+    // The engine is built by the worker for the settings and block size of the first run(), the input is
+    // passed through until it is ready, undelayed. The worker owns the engine until it replies, but MIDI and the
+    // trigger are still followed so no note off is lost and the pitch is where it should be once it is back
+    if (!plugin->ready)
+    {
+        if (!plugin->construct_requested && plugin->schedule)
+        {
+            if (!plugin->Configuration(fidelity, decimate, n_samples, &msg.nBuffers, &msg.factor))
+                plugin->Configuration(kDefaultFidelity, decimate, n_samples, &msg.nBuffers, &msg.factor);
+            plugin->construct_requested = plugin->schedule->schedule_work(plugin->schedule->handle, sizeof(msg), &msg) == LV2_WORKER_SUCCESS;
+        }
+
+        plugin->Control(n_samples);
+        if (plugin->ports[OUT] != plugin->ports[IN])
+            memcpy(plugin->ports[OUT], plugin->ports[IN], n_samples*sizeof(float));
+        *(plugin->ports[LATENCY]) = 0.0f;
+        return;
+    }
+
+    bool record = (*(plugin->ports[RECORDER]) >= 0.5f) && plugin->schedule;
+    bool dump = (*(plugin->ports[DUMP]) >= 0.5f);
+    int threads = std::min(std::max((int)(*(plugin->ports[THREADS])+0.5f), 1), BINPOOL_MAX_THREADS);
+
+    if (plugin->schedule && threads != plugin->threads && !plugin->threads_requested)
+    {
+        WorkMessage msg = {WORK_THREADS, n_samples, NULL};
+        sched_param param;
+        msg.threads = threads;
+        pthread_getschedparam(pthread_self(), &msg.policy, &param);
+        msg.priority = param.sched_priority;
+        plugin->threads_requested = plugin->schedule->schedule_work(plugin->schedule->handle, sizeof(msg), &msg) == LV2_WORKER_SUCCESS;
+    }
+
+    if (record && !plugin->recorder && !plugin->recorder_requested)
+    {
+        WorkMessage msg = {WORK_ALLOCATE, n_samples, NULL, 0, 0, 0};
+        plugin->recorder_requested = true;
+        plugin->schedule->schedule_work(plugin->schedule->handle, sizeof(msg), &msg);
+    }
+
+    FlightRecorder *recorder = plugin->recorder;
+    record = record && recorder && !recorder->busy;
+
+    // The helpers are woken before the block so they are spinning by the time its hops are split, and sleep
+    // again after it
+    BinPool *pool = plugin->pool;
+    if (pool)
+        pool->Wake();
+
+    // Recording is timed apart from the processing, the copy of the arena into a checkpoint would otherwise make
+    // the spikes that get dumped
+    timespec start, processing, end;
+    if (record)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        plugin->Record(n_samples);
+        clock_gettime(CLOCK_MONOTONIC, &processing);
+    }
+
+    Process(instance, n_samples);
+    if (pool)
+        pool->Park();
+
+    if (record)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double ns = (end.tv_sec - processing.tv_sec)*1e9 + (end.tv_nsec - processing.tv_nsec);
+        double record_ns = (processing.tv_sec - start.tv_sec)*1e9 + (processing.tv_nsec - start.tv_nsec);
+        recorder->End(plugin->ports[OUT], (uint32_t)std::min(ns, 4e9), (uint32_t)std::min(record_ns, 4e9), plugin->current_s,
+                      plugin->ramp_position, plugin->ramp_target, plugin->ramp_samples_remaining);
+
+        // A block over its share of the block period is dumped once a whole segment of history is held,
+        // the Dump button writes whatever is there
+        double budget = *(plugin->ports[SPIKE_BUDGET]) * 1e7 * n_samples / plugin->SampleRate;
+        if ((dump && !plugin->prev_dump) || (recorder->Full() && ns > budget))
+        {
+            WorkMessage msg = {WORK_DUMP, n_samples, recorder, 0, 0, 0};
+            recorder->busy = true;
+            if (plugin->schedule->schedule_work(plugin->schedule->handle, sizeof(msg), &msg) != LV2_WORKER_SUCCESS)
+                recorder->busy = false;
+        }
+    }
+    plugin->prev_dump = dump;
+}
+
+// Stores the checkpoint when one is due and the inputs of the block, before it is processed
+void Ricochet::Record(uint32_t n_samples)
+{
+    char *state = recorder->Checkpoint(arena.base, arena.used, n_samples);
+    if (state)
+        SaveState(state);
+
+    float values[PLUGIN_PORT_COUNT];
+    for (int p=0; p<PLUGIN_PORT_COUNT; p++)
+        values[p] = (p == IN || p == OUT || p == CONTROL) ? 0.0f : *(ports[p]);
+    recorder->Begin(ports[IN], n_samples, values);
+
+    if (control && midi_MidiEvent)
+    {
+        LV2_ATOM_SEQUENCE_FOREACH(control, ev)
+        {
+            if (ev->body.type == midi_MidiEvent)
+                recorder->Event((uint32_t)ev->time.frames, (const uint8_t*)(ev + 1), ev->body.size);
+        }
+    }
+}
+
+/**********************************************************************************************************************************************************/
+
+void Ricochet::Process(LV2_Handle instance, uint32_t n_samples)
+{
+    Ricochet *plugin = (Ricochet *) instance;
+
     float *in           = plugin->ports[IN];
     float *out          = plugin->ports[OUT];
-    bool   trigger      = (*(plugin->ports[TRIGGER]) >= 0.5f);
-    bool   latch        = (*(plugin->ports[MODE])    >= 0.5f);
-    double interval     = (double)(*(plugin->ports[INTERVAL]));
-    bool   up           = (*(plugin->ports[DIRECTION]) >= 0.5f);
-    double shift        = std::max(0.0, (double)(*(plugin->ports[SHIFT_TIME])));
-    double retrn        = std::max(0.0, (double)(*(plugin->ports[RETURN_TIME])));
     double wet_gain     = (double)(*(plugin->ports[WET_GAIN]));
     int    clean        = (int)(*(plugin->ports[CLEAN])+0.5f);
     int    fidelity     = (int)(*(plugin->ports[FIDELITY])+0.5f);
     bool   true_bypass  = (*(plugin->ports[TRUE_BYPASS]) >= 0.5f);
+    bool   decimate     = (*(plugin->ports[DECIMATE]) >= 0.5f);
+    int    window       = (*(plugin->ports[WINDOW]) >= 0.5f) ? ASYMMETRIC_WINDOW : HANN_WINDOW;
+    int    synthesis    = std::min(std::max((int)(*(plugin->ports[SYNTHESIS])+0.5f), 0), (int)SINUSOIDAL_SYNTHESIS);
+    int    quality      = std::min(std::max((int)(*(plugin->ports[INTERPOLATION])+0.5f), 0), (int)SINC_INTERPOLATION);
+    bool   transients   = (*(plugin->ports[TRANSIENTS]) >= 0.5f);
 
-    plugin->SetFidelity(fidelity, n_samples);
-    double semitone = plugin->UpdateStep(trigger, latch, interval, up, shift, retrn, n_samples);
+    plugin->SetFidelity(fidelity, decimate, window, n_samples);
+    if (!plugin->ready)
+    {
+        if (out != in)
+            memcpy(out, in, n_samples * sizeof(float));
+        *(plugin->ports[LATENCY]) = 0.0f;
+        return;
+    }
+    (plugin->objs)->SetSynthesis(synthesis);
+    (plugin->objs)->resampler->quality = quality;
+    (plugin->obja)->transients = transients;
+
+    // With true bypass the resting path is the undelayed input, report the processed delay otherwise
+    *(plugin->ports[LATENCY]) = true_bypass ? 0.0f : (float)plugin->Latency();
+
+    double semitone = plugin->Control(n_samples);
 
     // --- STATE MACHINE FOR BYPASS LOGIC ---
 
@@ -298,13 +704,26 @@ void Ricochet::run(LV2_Handle instance, uint32_t n_samples)
     if (true_bypass && !plugin->fading_in && !plugin->fading_out && !plugin->engaged 
         && plugin->ramp_position == 0.0 && plugin->ramp_samples_remaining == 0.0) 
     {
-        memcpy(out, in, n_samples * sizeof(float));
+        if (out != in)
+            memcpy(out, in, n_samples * sizeof(float));
         plugin->was_true_bypassing = true; // Mark that we have been sleeping
         return;
     }
 
     // Standard Processing Logic
-    (plugin->obja)->PreAnalysis(plugin->nBuffers, in);
+    // With decimation the vocoder sees the band-limited signal at the lower rate, the rest stays dry
+    float *engine_in  = in;
+    float *engine_out = out;
+    const uint32_t hop = (uint32_t)(plugin->obja)->hopa;
+
+    if (plugin->objd)
+    {
+        (plugin->objd)->Down(in, plugin->low_in);
+        engine_in = plugin->low_in;
+        engine_out = plugin->low_out;
+    }
+
+    (plugin->obja)->PreAnalysis(plugin->nBuffers, engine_in);
     (plugin->objs)->PreSinthesis();
 
     // Safety: If input is silent, output silence (saves CPU on denormals)
@@ -317,21 +736,33 @@ void Ricochet::run(LV2_Handle instance, uint32_t n_samples)
     (plugin->objg)->SetGaindB(wet_gain);
 
     bool processed = false;
+    const float *dry_in = in;
     if (plugin->cont < plugin->nBuffers-1)
     {
         plugin->cont = plugin->cont + 1;
     }
     else
     {
-        (plugin->obja)->Analysis();
-        (plugin->objs)->Sinthesis(semitone);
-        (plugin->objg)->SimpleGain((plugin->objs)->yshift, out);
+        // The host may hand over the same buffer for in and out. Only the crossfades read the input after the
+        // output is written, so only then is it staged
+        if (out == in && (plugin->fading_in || plugin->fading_out))
+        {
+            memcpy(plugin->staged_in, in, n_samples * sizeof(float));
+            dry_in = plugin->staged_in;
+        }
+
+        (plugin->obja)->Analysis(plugin->pool);
+        (plugin->objs)->Sinthesis(semitone, plugin->pool);
+        (plugin->objg)->SimpleGain((plugin->objs)->yshift, engine_out);
         if (plugin->auto_add_dry || clean == 1)
         {
-            const double *dry = (plugin->obja)->frames;
-            for (uint32_t i = 0; i<n_samples; ++i)
-                out[i] += static_cast<float>(dry[i]);
+            // Dry samples taken at the same delay as the wet signal, which reaches into the history kept before frames
+            const double *dry = &(plugin->obja)->frames[(plugin->obja)->N - (plugin->obja)->hopa - (plugin->objs)->Delay()];
+            for (uint32_t i = 0; i<hop; ++i)
+                engine_out[i] += static_cast<float>(dry[i]);
         }
+        if (plugin->objd)
+            (plugin->objd)->Up(engine_out, out, (plugin->objs)->Delay() * plugin->factor);
         processed = true;
     }
 
@@ -339,9 +770,6 @@ void Ricochet::run(LV2_Handle instance, uint32_t n_samples)
     
     if (processed) 
     {
-        // Save current output for next block (in case we need it, though less critical now)
-        memcpy(plugin->last_out, out, n_samples * sizeof(float));
-
         if (plugin->fading_in) 
         {
             // Fading FROM Input TO Wet
@@ -349,7 +777,7 @@ void Ricochet::run(LV2_Handle instance, uint32_t n_samples)
             {
                 double f = std::min(1.0, plugin->fade_progress);
                 // Linear Crossfade: Dry -> Wet
-                out[i] = in[i] * (1.0f - f) + out[i] * f;
+                out[i] = dry_in[i] * (1.0f - f) + out[i] * f;
                 plugin->fade_progress += plugin->fade_step;
             }
             if (plugin->fade_progress >= 1.0) plugin->fading_in = false;
@@ -361,7 +789,7 @@ void Ricochet::run(LV2_Handle instance, uint32_t n_samples)
             {
                 double f = std::min(1.0, plugin->fade_progress);
                 // Linear Crossfade: Wet -> Dry
-                out[i] = out[i] * (1.0f - f) + in[i] * f;
+                out[i] = out[i] * (1.0f - f) + dry_in[i] * f;
                 plugin->fade_progress += plugin->fade_step;
             }
             if (plugin->fade_progress >= 1.0) plugin->fading_out = false;
@@ -373,7 +801,8 @@ void Ricochet::run(LV2_Handle instance, uint32_t n_samples)
         if (plugin->fading_in) 
         {
             // If we are fading in but DSP isn't ready, output dry to avoid silence gap
-            memcpy(out, in, n_samples * sizeof(float));
+            if (out != in)
+                memcpy(out, in, n_samples * sizeof(float));
         } 
         else 
         {
@@ -393,16 +822,253 @@ void Ricochet::cleanup(LV2_Handle instance)
 
 const void* Ricochet::extension_data(const char* uri)
 {
+    static const LV2_Worker_Interface worker = {work, work_response, NULL};
+    static const RecorderReplay replay = {Ricochet::replay};
+    if (strcmp(uri, LV2_WORKER__interface) == 0)
+        return &worker;
+    if (strcmp(uri, RECORDER_REPLAY_URI) == 0)
+        return &replay;
     return NULL;
 }
 
-double Ricochet::UpdateStep(bool trigger_active,
+/**********************************************************************************************************************************************************/
+
+// Runs in the worker thread: builds the engine while run() keeps away from it, starts and stops helper threads,
+// allocates the flight recorder, or writes a dump while the audio thread leaves it alone
+LV2_Worker_Status Ricochet::work(LV2_Handle instance, LV2_Worker_Respond_Function respond, LV2_Worker_Respond_Handle handle, uint32_t size, const void *data)
+{
+    Ricochet *plugin = (Ricochet *) instance;
+    WorkMessage msg = *(const WorkMessage*)data;
+
+    if (msg.type == WORK_CONSTRUCT)
+    {
+        try
+        {
+            plugin->Realloc(msg.n_samples, msg.nBuffers, msg.factor, msg.window);
+        }
+        catch (const std::bad_alloc&)
+        {
+            printf("Ricochet: not enough memory for the pitch shifter\n");
+            plugin->Destruct();
+            msg.nBuffers = 0;
+        }
+    }
+    else if (msg.type == WORK_THREADS)
+    {
+        // Without the memory for the pool the bins stay on the audio thread, and are not asked for again
+        try
+        {
+            msg.pool = (msg.threads > 1) ? new BinPool(msg.threads - 1, msg.policy, msg.priority) : NULL;
+        }
+        catch (const std::bad_alloc&)
+        {
+            printf("Ricochet: not enough memory for the helper threads\n");
+            msg.pool = NULL;
+        }
+    }
+    else if (msg.type == WORK_RELEASE)
+    {
+        delete msg.pool;
+        return LV2_WORKER_SUCCESS;
+    }
+    else if (msg.type == WORK_ALLOCATE)
+    {
+        try
+        {
+            msg.recorder = new FlightRecorder(plugin->SampleRate, msg.n_samples, PLUGIN_PORT_COUNT, plugin->state_bytes, plugin->MaxArenaSize(msg.n_samples));
+        }
+        catch (const std::bad_alloc&)
+        {
+            // The reply without a recorder leaves it off, it is not asked for again
+            printf("Ricochet: not enough memory for the flight recorder\n");
+            msg.recorder = NULL;
+        }
+    }
+    else
+    {
+        const char *dir = getenv("RICOCHET_DUMP_DIR");
+        char stamp[32];
+        char path[1024];
+        time_t now = time(NULL);
+        strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime(&now));
+        snprintf(path, sizeof(path), "%s/ricochet-%s-%d.rcfr", dir ? dir : "/tmp", stamp, plugin->dumps++);
+
+        if (msg.recorder->Write(path))
+            printf("Ricochet: flight recorder dump written to %s\n", path);
+        else
+            printf("Ricochet: failed to write flight recorder dump '%s'\n", path);
+    }
+
+    respond(handle, sizeof(msg), &msg);
+    return LV2_WORKER_SUCCESS;
+}
+
+LV2_Worker_Status Ricochet::work_response(LV2_Handle instance, uint32_t size, const void *data)
+{
+    Ricochet *plugin = (Ricochet *) instance;
+    const WorkMessage *msg = (const WorkMessage*)data;
+
+    if (msg->type == WORK_CONSTRUCT)
+    {
+        // An engine that could not be built is not asked for again, the input is passed through
+        if (msg->nBuffers == 0)
+            return LV2_WORKER_SUCCESS;
+        plugin->Ready();
+        plugin->construct_requested = false;
+    }
+    else if (msg->type == WORK_THREADS)
+    {
+        // The pool that was in use goes back to the worker, it is only deleted here if the worker is full
+        WorkMessage release = {WORK_RELEASE, 0, NULL};
+        release.pool = plugin->pool;
+        plugin->pool = msg->pool;
+        plugin->threads = msg->threads;
+        plugin->threads_requested = false;
+        if (release.pool && plugin->schedule->schedule_work(plugin->schedule->handle, sizeof(release), &release) != LV2_WORKER_SUCCESS)
+            delete release.pool;
+    }
+    else if (msg->type == WORK_ALLOCATE)
+        plugin->recorder = msg->recorder;
+    else
+        msg->recorder->Restart();
+    return LV2_WORKER_SUCCESS;
+}
+
+/**********************************************************************************************************************************************************/
+
+int Ricochet::replay(void *instance, const char *dump, const char *output)
+{
+    // A dump too large to be read into memory can't be replayed
+    try
+    {
+        return ((Ricochet *) instance)->Replay(dump, output);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return -1;
+    }
+}
+
+// Restores the checkpoint of a dump and runs its blocks, outside of any host thread. The output is written to
+// output as raw floats when it is not NULL
+int Ricochet::Replay(const char *dump, const char *output)
+{
+    if (!ready)
+        return -1;
+    FILE *f = fopen(dump, "rb");
+    if (!f)
+        return -1;
+    std::vector<char> file;
+    char chunk[65536];
+    size_t got;
+    while ((got = fread(chunk, 1, sizeof(chunk), f)) > 0)
+        file.insert(file.end(), chunk, chunk + got);
+    fclose(f);
+
+    RecorderHeader h;
+    if (file.size() < sizeof(h))
+        return -1;
+    memcpy(&h, file.data(), sizeof(h));
+    size_t bytes = sizeof(h) + h.state_bytes + h.arena_bytes + h.nblocks*(sizeof(RecorderBlock) + sizeof(float)*h.ncontrols) +
+                   h.nevents*sizeof(RecorderEvent) + h.samples*sizeof(float);
+    if (h.magic != RECORDER_MAGIC || h.version != RECORDER_VERSION || h.samplerate != SampleRate ||
+        h.ncontrols != PLUGIN_PORT_COUNT || h.state_bytes != state_bytes || file.size() != bytes || (h.nevents && !midi_MidiEvent))
+        return -1;
+
+    const char *state = file.data() + sizeof(h);
+    const char *bytes_arena = state + h.state_bytes;
+    const RecorderBlock *blocks = (const RecorderBlock*)(bytes_arena + h.arena_bytes);
+    const float *values = (const float*)(blocks + h.nblocks);
+    const RecorderEvent *events = (const RecorderEvent*)(values + h.nblocks*h.ncontrols);
+    const float *audio = (const float*)(events + h.nevents);
+
+    if (!LoadState(state, bytes_arena, h.arena_bytes))
+        return -1;
+
+    FILE *out = output ? fopen(output, "wb") : NULL;
+    float *saved[PLUGIN_PORT_COUNT];
+    memcpy(saved, ports, sizeof(ports));
+    const LV2_Atom_Sequence *saved_control = control;
+
+    float port_values[PLUGIN_PORT_COUNT];
+    std::vector<float> in(h.max_block), wet(h.max_block);
+    std::vector<uint64_t> sequence(2 + 3*h.nevents);
+    int mismatches = 0;
+
+    for (uint32_t b=0; b<h.nblocks; b++)
+    {
+        const RecorderBlock &block = blocks[b];
+        if (block.n_samples > h.max_block)
+        {
+            mismatches = -1;
+            break;
+        }
+        memcpy(port_values, &values[b*h.ncontrols], sizeof(port_values));
+        for (int p=0; p<PLUGIN_PORT_COUNT; p++)
+            ports[p] = &port_values[p];
+        memcpy(in.data(), audio, sizeof(float)*block.n_samples);
+        ports[IN] = in.data();
+        ports[OUT] = wet.data();
+
+        // The events of the block as an atom sequence, each one padded to 8 bytes
+        LV2_Atom_Sequence *seq = (LV2_Atom_Sequence*)sequence.data();
+        seq->atom.type = 0;
+        seq->atom.size = sizeof(LV2_Atom_Sequence_Body);
+        seq->body.unit = 0;
+        seq->body.pad = 0;
+        LV2_Atom_Event *ev = (LV2_Atom_Event*)(seq + 1);
+        for (uint32_t e=0; e<block.nevents; e++, events++)
+        {
+            ev->time.frames = events->frame;
+            ev->body.type = midi_MidiEvent;
+            ev->body.size = events->size;
+            memcpy(ev + 1, events->data, events->size);
+            seq->atom.size += sizeof(LV2_Atom_Event) + 8;
+            ev = (LV2_Atom_Event*)((char*)(ev + 1) + 8);
+        }
+        control = seq;
+
+        Process(this, block.n_samples);
+
+        if (FlightRecorder::Hash(wet.data(), block.n_samples) != block.out_hash || current_s != block.semitone)
+            mismatches++;
+        if (out)
+            fwrite(wet.data(), sizeof(float), block.n_samples, out);
+        audio += block.n_samples;
+    }
+
+    if (out)
+        fclose(out);
+    memcpy(ports, saved, sizeof(ports));
+    control = saved_control;
+    return mismatches;
+}
+
+// Largest arena any Fidelity, Window and Decimate setting can need at this block size
+size_t Ricochet::MaxArenaSize(uint32_t n_samples)
+{
+    size_t bytes = 0;
+    int factors[2] = {1, DecimationFactor(SampleRate)};
+    for (int d=0; d<2; d++)
+    {
+        int f = (n_samples % factors[d] == 0) ? factors[d] : 1;
+        uint32_t hop = n_samples / f;
+        for (int i=0; i<kFidelityCount; i++)
+        {
+            int n = nBuffersMs(hop, SampleRate / f, kFidelityFrameMs[i]);
+            bytes = std::max(bytes, ArenaSize(n_samples, n, f, HANN_WINDOW));
+            bytes = std::max(bytes, ArenaSize(n_samples, n, f, ASYMMETRIC_WINDOW));
+        }
+    }
+    return bytes;
+}
+
+void Ricochet::UpdateTarget(bool trigger_active,
                             bool latch_mode,
                             double interval_control,
                             bool direction_up,
                             double shift_time,
-                            double return_time,
-                            uint32_t n_samples)
+                            double return_time)
 {
     double clamped = std::max(0.0, std::min(interval_control, static_cast<double>(kIntervalChoiceCount - 1)));
     size_t interval_index = static_cast<size_t>(clamped + 0.5);
@@ -411,6 +1077,7 @@ double Ricochet::UpdateStep(bool trigger_active,
 
     const IntervalChoice &choice = kIntervalChoices[interval_index];
     auto_add_dry = choice.force_dry;
+    ramp_span = direction_up ? choice.semitones : -choice.semitones;
 
     if (!latch_mode && last_mode_was_latch)
         latched_on = false;
@@ -433,7 +1100,7 @@ double Ricochet::UpdateStep(bool trigger_active,
 
     this->engaged = engaged;
 
-    double target = engaged ? (direction_up ? choice.semitones : -choice.semitones) : 0.0;
+    double target = engaged ? ramp_span : 0.0;
     double duration = engaged ? shift_time : return_time;
 
     // If pitch needs to change, enforce a minimum duration of 20ms to prevent a pop
@@ -447,8 +1114,7 @@ double Ricochet::UpdateStep(bool trigger_active,
         ramp_samples_remaining = 0.0;
         ramp_step = 0.0;
         ramp_active_time = 0.0;
-        current_s = target;
-        return current_s;
+        return;
     }
 
     if (std::fabs(target - ramp_target) > 1e-9 ||
@@ -461,34 +1127,132 @@ double Ricochet::UpdateStep(bool trigger_active,
             ramp_samples_remaining = 1.0;
         ramp_step = (ramp_target - ramp_position) / ramp_samples_remaining;
     }
+}
 
-    double start = ramp_position;
+// Moves the ramp n_samples forward and returns the sum over them of the pitch, the ramp with the bend
+double Ricochet::AdvanceRamp(uint32_t n_samples, double bend)
+{
+    if (n_samples == 0)
+        return 0.0;
 
-    if (ramp_samples_remaining > 0.0)
+    // The bend is added to the ramp but can't take the pitch past the interval either way, so bending an
+    // engaged ramp up holds it at the interval instead of doubling it. The ramp itself is never held back
+    double limit = std::fabs(ramp_span);
+    auto area = [&](double from, double to, double n)
     {
-        double advance = std::min(ramp_samples_remaining, static_cast<double>(n_samples));
-        ramp_position += ramp_step * advance;
-        ramp_samples_remaining -= advance;
+        double lo = std::min(-limit, std::min(from, to));
+        double hi = std::max(limit, std::max(from, to));
+        from += bend;
+        to += bend;
+        if (std::fabs(to - from) < 1e-9)
+            return std::max(lo, std::min(from, hi)) * n;
+        return n * (ClampedIntegral(to, lo, hi) - ClampedIntegral(from, lo, hi)) / (to - from);
+    };
 
-        if ((ramp_step >= 0.0 && ramp_position >= ramp_target) ||
-            (ramp_step <= 0.0 && ramp_position <= ramp_target) ||
-            ramp_samples_remaining <= 0.0)
-        {
-            ramp_position = ramp_target;
-            ramp_samples_remaining = 0.0;
-            ramp_step = 0.0;
-        }
+    if (ramp_samples_remaining <= 0.0)
+    {
+        ramp_position = ramp_target;
+        return area(ramp_position, ramp_position, n_samples);
     }
-    else
+
+    double start = ramp_position;
+    double advance = std::min(ramp_samples_remaining, static_cast<double>(n_samples));
+    ramp_position += ramp_step * advance;
+    ramp_samples_remaining -= advance;
+
+    if ((ramp_step >= 0.0 && ramp_position >= ramp_target) ||
+        (ramp_step <= 0.0 && ramp_position <= ramp_target) ||
+        ramp_samples_remaining <= 0.0)
     {
         ramp_position = ramp_target;
+        ramp_samples_remaining = 0.0;
+        ramp_step = 0.0;
     }
 
-    double end = ramp_position;
-    if (std::fabs(end - start) > 1e-12)
-        current_s = 0.5 * (start + end);
-    else
-        current_s = end;
+    return area(start, ramp_position, advance) + area(ramp_position, ramp_position, n_samples - advance);
+}
+
+// Follows the trigger, the interval controls and the MIDI of a block, and returns its mean pitch. The ramp is
+// advanced up to each event and retargeted at its frame, the vocoder then runs on the mean pitch of the block
+double Ricochet::Control(uint32_t n_samples)
+{
+    bool   trigger      = (*(ports[TRIGGER]) >= 0.5f);
+    bool   latch        = (*(ports[MODE])    >= 0.5f);
+    double interval     = (double)(*(ports[INTERVAL]));
+    bool   up           = (*(ports[DIRECTION]) >= 0.5f);
+    double shift        = std::max(0.0, (double)(*(ports[SHIFT_TIME])));
+    double retrn        = std::max(0.0, (double)(*(ports[RETURN_TIME])));
+
+    // Moving the Interval knob takes over from the last MIDI selection
+    if (interval != prev_interval_port)
+        midi_interval = -1.0;
+    prev_interval_port = interval;
+
+    double area = 0.0;
+    uint32_t pos = 0;
+    double bend = 0.0;
+
+    auto retarget = [&]()
+    {
+        UpdateTarget(trigger || midi_notes > 0 || midi_sustain, latch,
+                     midi_interval >= 0.0 ? midi_interval : interval, up, shift, retrn);
+        bend = midi_bend * ramp_span;
+    };
+
+    retarget();
+
+    if (control && midi_MidiEvent)
+    {
+        LV2_ATOM_SEQUENCE_FOREACH(control, ev)
+        {
+            if (ev->body.type != midi_MidiEvent)
+                continue;
+
+            uint32_t frame = (uint32_t)std::min(std::max(ev->time.frames, (int64_t)pos), (int64_t)n_samples);
+            area += AdvanceRamp(frame - pos, bend);
+            pos = frame;
+
+            ReadMidi((const uint8_t*)(ev + 1));
+            retarget();
+        }
+    }
+
+    area += AdvanceRamp(n_samples - pos, bend);
+    current_s = std::max(-24.0, std::min(area / n_samples, 24.0));
+
+    // A bent pitch has to be heard even with the trigger released
+    if (std::fabs(bend) > 1e-9)
+        engaged = true;
 
     return current_s;
 }
+
+// Note on/off and the sustain pedal hold the trigger, the foot controller picks the interval and
+// the pitch bend sweeps towards the selected interval. All channels are accepted.
+void Ricochet::ReadMidi(const uint8_t *msg)
+{
+    switch (lv2_midi_message_type(msg))
+    {
+        case LV2_MIDI_MSG_NOTE_ON:
+            // Velocity 0 is a note off
+            if (msg[2] > 0)
+                midi_notes++;
+            else
+                midi_notes = std::max(midi_notes - 1, 0);
+            break;
+        case LV2_MIDI_MSG_NOTE_OFF:
+            midi_notes = std::max(midi_notes - 1, 0);
+            break;
+        case LV2_MIDI_MSG_CONTROLLER:
+            if (msg[1] == LV2_MIDI_CTL_SUSTAIN)
+                midi_sustain = (msg[2] >= 64);
+            else if (msg[1] == LV2_MIDI_CTL_MSB_FOOT)
+                midi_interval = (double)(msg[2] * kIntervalChoiceCount / 128);
+            break;
+        case LV2_MIDI_MSG_BENDER:
+            midi_bend = std::max(-1.0, (double)(((msg[2] << 7) | msg[1]) - 8192) / 8192.0);
+            break;
+        default:
+            break;
+    }
+}
@@ -0,0 +1,207 @@
+// Per-hop time of the vocoder at Insane fidelity with its bins split over 1 to 4 threads. Every hop is run as a block
+// of the plugin is: the helpers are woken, Analysis() and Sinthesis() are split across them, and they are parked
+// again, all of it timed. The helpers are limited to the cores less one, so the threads actually used are printed
+// next to the ones asked for. After it the per-bin loops of a hop, Analysis' unwrap and Sinthesis' spectrum, are
+// timed alone with the frame size only known at run time, as the engine has it, and fixed when compiling, which is
+// what an engine templated on the fidelity presets would run. Last the resampler that reads the overlap-add out is
+// timed for a hop of the block size at each Interpolation quality.
+// Usage: ricochet-bench [samplerate] [block] [seconds]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sched.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "PitchShifterClasses.h"
+#include "BinPool.h"
+
+#define INSANE_FRAME_MS 64.0 //kFidelityFrameMs of Insane in src/Ricochet.cpp
+#define SEMITONES 7.0
+#define BINS_HOP 128 //Hop of the per-bin loops timed alone
+#define BINS_REPEAT 2000 //Hops timed in a row
+#define BINS_ROUNDS 10 //Rounds of BINS_REPEAT hops, the fastest one is kept
+
+static const char *kWindows[] = {"hann", "asym"};
+static const char *kInterpolations[] = {"linear", "cubic", "sinc"};
+static const double kRatios[] = {0.5, 1.4983, 2.0}; //Octave down, fifth and octave up
+
+struct Timing
+{
+	double mean, max; //Microseconds per hop
+};
+
+//Frames the per-bin loops are timed with, across the range of the presets at 48 kHz
+#define FRAMES(F) F(512) F(1024) F(2048) F(3072)
+
+struct Bins
+{
+	std::vector<float> X, Y; //fftwf_complex spectra in and out
+	std::vector<uint32_t> arg;
+	std::vector<double> mag, omega;
+};
+
+//The per-bin loops of a hop of the vocoder
+static inline void Hop(int Na, Bins &b)
+{
+	int bins = Na/2 + 1;
+	UnwrapBins((fftwf_complex *)&b.X[0], &b.arg[0], &b.mag[0], &b.omega[0], 0, bins, Na, BINS_HOP, 1.0/BINS_HOP);
+	SpectrumBins(&b.arg[0], &b.mag[0], (fftwf_complex *)&b.Y[0], 0, bins);
+}
+
+static void RunTimeHop(int Na, Bins &b)
+{
+	Hop(Na, b);
+}
+
+template <int Na> static void FixedHop(int, Bins &b)
+{
+	Hop(Na, b);
+}
+
+//Nanoseconds per hop in the fastest round
+static double BenchBins(void (*hop)(int, Bins &), int Na, Bins &b)
+{
+	double best = INFINITY;
+	for (int round=0; round<BINS_ROUNDS; round++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		for (int r=0; r<BINS_REPEAT; r++)
+			hop(Na, b);
+		best = std::min(best, std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count()/BINS_REPEAT);
+	}
+	return best;
+}
+
+//Nanoseconds per hop of n samples read at ratio, in the fastest round
+static double BenchResampler(int quality, double ratio, int n)
+{
+	Resampler resampler;
+	resampler.quality = quality;
+	std::vector<float> in((size_t)(n*ratio) + 2*SINC_TAPS + 2);
+	std::vector<double> out(n);
+	for (size_t i=0; i<in.size(); i++)
+		in[i] = (float)sin(0.37*i);
+
+	double best = INFINITY;
+	for (int round=0; round<BINS_ROUNDS; round++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		for (int r=0; r<BINS_REPEAT; r++)
+			resampler.Process(&in[0], resampler.Delay() + 0.001*r/BINS_REPEAT, ratio, n, &out[0]);
+		best = std::min(best, std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count()/BINS_REPEAT);
+	}
+	return best;
+}
+
+static Timing Bench(double samplerate, uint32_t hop, int window, int threads, std::vector<float> &x)
+{
+	int nBuffers = nBuffersMs(hop, samplerate, INSANE_FRAME_MS);
+	Arena arena;
+	arena.Reserve(PSAnalysis::ArenaSize(hop, nBuffers, window) + PSSinthesis::ArenaSize(hop, nBuffers));
+	PSAnalysis a(hop, nBuffers, window, &arena, "");
+	PSSinthesis s(&a, &arena, "");
+	BinPool *pool = (threads > 1) ? new BinPool(threads - 1, SCHED_OTHER, 0) : NULL;
+
+	Timing timing = {0, 0};
+	long hops = 0;
+	int cont = 0;
+	for (size_t t=0; t+hop<=x.size(); t+=hop)
+	{
+		a.PreAnalysis(nBuffers, &x[t]);
+		s.PreSinthesis();
+		if (cont < nBuffers - 1)
+		{
+			cont++;
+			continue;
+		}
+		auto start = std::chrono::steady_clock::now();
+		if (pool)
+			pool->Wake();
+		a.Analysis(pool);
+		s.Sinthesis(SEMITONES, pool);
+		if (pool)
+			pool->Park();
+		double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+		timing.mean += us;
+		timing.max = std::max(timing.max, us);
+		hops++;
+	}
+	timing.mean /= std::max(hops, 1L);
+	delete pool;
+	return timing;
+}
+
+int main(int argc, char **argv)
+{
+	double samplerate = (argc > 1) ? atof(argv[1]) : 48000.0;
+	int block = (argc > 2) ? atoi(argv[2]) : 128;
+	double seconds = (argc > 3) ? atof(argv[3]) : 5.0;
+	if (samplerate <= 0 || block <= 0 || seconds <= 0)
+	{
+		fprintf(stderr, "usage: ricochet-bench [samplerate] [block] [seconds]\n");
+		return 2;
+	}
+
+	//A chord, so every bin has something to do
+	std::vector<float> x((size_t)(seconds*samplerate));
+	for (size_t t=0; t<x.size(); t++)
+	{
+		double time = t/samplerate;
+		x[t] = (float)(0.2*sin(2*M_PI*220.0*time) + 0.2*sin(2*M_PI*277.18*time) + 0.2*sin(2*M_PI*329.63*time));
+	}
+
+	double period = 1e6*block/samplerate;
+	printf("Insane (%.0f ms frames) at %.0f Hz, hops of %d samples (%.1f us), %+.0f semitones, %u cores\n",
+	       INSANE_FRAME_MS, samplerate, block, period, SEMITONES, std::thread::hardware_concurrency());
+	printf("window threads  used   mean us    max us  mean/period\n");
+	for (int w=0; w<2; w++)
+	{
+		int window = w ? ASYMMETRIC_WINDOW : HANN_WINDOW;
+		for (int threads=1; threads<=BINPOOL_MAX_THREADS; threads++)
+		{
+			int used = 1;
+			if (threads > 1)
+			{
+				BinPool pool(threads - 1, SCHED_OTHER, 0);
+				used = pool.helpers + 1;
+			}
+			Timing timing = Bench(samplerate, (uint32_t)block, window, threads, x);
+			printf("%-6s %7d %5d %9.1f %9.1f %11.1f%%\n", kWindows[w], threads, used, timing.mean, timing.max, 100*timing.mean/period);
+		}
+	}
+
+	printf("\nper-bin loops of a hop, hops of %d samples\n", BINS_HOP);
+	printf("frame  run time ns  fixed ns  run time/fixed\n");
+#define FIXED(n) {n, FixedHop<n>},
+	struct {int frame; void (*hop)(int, Bins &);} fixed[] = {FRAMES(FIXED)};
+	for (auto &f : fixed)
+	{
+		Bins b;
+		b.X.resize(f.frame + 2);
+		b.Y.resize(f.frame + 2);
+		b.arg.resize(f.frame/2 + 1);
+		b.mag.resize(f.frame/2 + 1);
+		b.omega.resize(f.frame/2 + 1);
+		for (int i=0; i<f.frame + 2; i++)
+			b.X[i] = (float)sin(0.37*i);
+		volatile int frame = f.frame; //Read back, so the run time loops can't know it
+		double run = BenchBins(RunTimeHop, frame, b);
+		double fix = BenchBins(f.hop, f.frame, b);
+		printf("%5d %12.0f %9.0f %15.2f\n", f.frame, run, fix, run/fix);
+	}
+
+	printf("\nresampler, hops of %d samples\n", block);
+	printf("interp  ratio  ns per hop  ns per sample\n");
+	for (int quality=LINEAR_INTERPOLATION; quality<=SINC_INTERPOLATION; quality++)
+	{
+		for (double ratio : kRatios)
+		{
+			double ns = BenchResampler(quality, ratio, block);
+			printf("%-6s %6.3f %11.0f %14.2f\n", kInterpolations[quality], ratio, ns, ns/block);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,482 @@
+// Offline evaluation of the engine settings. Reference signals (sines, chords, plucks and clicks) are shifted by the
+// vocoder at every frame length, window, synthesis and interpolation, and each setting is measured for:
+//   cents    mean pitch error of the strongest partial of the input once shifted, looked for within a semitone
+//   dist     energy away from the expected partials of the tonal signals, in dB of the total
+//   smear    time over which 10% to 90% of the energy of a click arrives, in ms, less that of the input
+//   latency  Delay() of the synthesis mode, in ms
+//   cpu      time spent in the vocoder per second of audio, in percent of a core
+// It prints every setting at each block size, the Pareto front of all five, and the frame lengths of the Fidelity
+// presets it suggests. The presets must give more hops than the one before at every block size swept, or two of them
+// would build the same engine. The cpu column is only worth ranking on when the FFT library printed first is FFTW.
+// Usage: ricochet-evaluate [samplerate] [block...]   (blocks of 64, 128 and 256 samples by default)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <complex>
+#include <vector>
+#include <algorithm>
+#include "PitchShifterClasses.h"
+
+//Frame lengths swept, in ms. At 48 kHz and 128 samples they are 3 to 24 hops, up to the memory of the longest preset
+static const double kFrameMs[] = {8.0, 10.667, 13.333, 16.0, 21.333, 26.667, 32.0, 42.667, 53.333, 64.0};
+static const int kFrames = sizeof(kFrameMs) / sizeof(kFrameMs[0]);
+
+static const double kShifts[] = {-12.0, 7.0, 12.0};
+static const int kShifts_n = sizeof(kShifts) / sizeof(kShifts[0]);
+
+#define PRESETS 6
+#define SPECTRUM 16384 //Samples of output analysed for pitch and distortion
+#define PARTIAL_BINS 4 //Bins either side of an expected partial that are not counted as distortion
+
+static const char *kWindows[] = {"hann", "asym"};
+static const char *kSyntheses[] = {"standard", "locked", "sinusoid"};
+static const char *kInterpolations[] = {"linear", "cubic", "sinc"};
+
+struct Signal
+{
+	const char *name;
+	std::vector<float> x;
+	std::vector<double> partials; //Frequencies of the input, none for clicks
+	std::vector<long> onsets; //Samples where the clicks start
+};
+
+struct Metrics
+{
+	int frame; //Index in kFrameMs
+	uint32_t block;
+	int window, synthesis, quality;
+	double cents, dist, smear, latency, cpu;
+};
+
+typedef std::complex<double> cd;
+
+static void FFT(std::vector<cd> &a)
+{
+	size_t n = a.size();
+	for (size_t i=1, j=0; i<n; i++)
+	{
+		size_t bit = n >> 1;
+		for (; j & bit; bit >>= 1)
+			j ^= bit;
+		j ^= bit;
+		if (i < j)
+			std::swap(a[i], a[j]);
+	}
+	for (size_t len=2; len<=n; len <<= 1)
+	{
+		cd wl = std::polar(1.0, -2*M_PI/len);
+		for (size_t i=0; i<n; i+=len)
+		{
+			cd w = 1;
+			for (size_t k=0; k<len/2; k++, w *= wl)
+			{
+				cd u = a[i+k], v = a[i+k+len/2]*w;
+				a[i+k] = u + v;
+				a[i+k+len/2] = u - v;
+			}
+		}
+	}
+}
+
+//Magnitude of the Hann windowed DTFT of x at frequency f, in cycles per sample
+static double Dtft(const float *x, int n, double f)
+{
+	cd acc = 0, w = std::polar(1.0, -2*M_PI*f), r = 1;
+	for (int i=0; i<n; i++, r *= w)
+		acc += (double)x[i] * 0.5*(1 - cos(2*M_PI*i/n)) * r;
+	return std::abs(acc);
+}
+
+//Frequency of the strongest partial of x between lo and hi Hz, refined past the FFT bin by a golden section
+//search on the DTFT
+static double Pitch(const float *x, int n, double samplerate, double lo_hz, double hi_hz)
+{
+	std::vector<cd> a(n);
+	for (int i=0; i<n; i++)
+		a[i] = (double)x[i] * 0.5*(1 - cos(2*M_PI*i/n));
+	FFT(a);
+	int first = std::max((int)ceil(lo_hz*n/samplerate), 2), last = std::min((int)(hi_hz*n/samplerate), n/2 - 2);
+	int peak = first;
+	for (int k=first+1; k<=last; k++)
+		if (std::abs(a[k]) > std::abs(a[peak]))
+			peak = k;
+
+	double lo = (peak - 1.0)/n, hi = (peak + 1.0)/n;
+	const double g = (sqrt(5.0) - 1)/2;
+	for (int it=0; it<40; it++)
+	{
+		double m1 = hi - g*(hi - lo), m2 = lo + g*(hi - lo);
+		if (Dtft(x, n, m1) > Dtft(x, n, m2))
+			hi = m2;
+		else
+			lo = m1;
+	}
+	return 0.5*(lo + hi)*samplerate;
+}
+
+//Energy outside the expected partials over the total, in dB
+static double Distortion(const float *x, int n, const std::vector<double> &partials, double samplerate)
+{
+	std::vector<cd> a(n);
+	for (int i=0; i<n; i++)
+		a[i] = (double)x[i] * 0.5*(1 - cos(2*M_PI*i/n));
+	FFT(a);
+	std::vector<bool> expected(n/2, false);
+	for (size_t p=0; p<partials.size(); p++)
+	{
+		int bin = (int)lround(partials[p]*n/samplerate);
+		for (int k=std::max(bin - PARTIAL_BINS, 0); k<=std::min(bin + PARTIAL_BINS, n/2 - 1); k++)
+			expected[k] = true;
+	}
+	double total = 1e-30, outside = 1e-30;
+	for (int k=1; k<n/2; k++)
+	{
+		double e = std::norm(a[k]);
+		total += e;
+		if (!expected[k])
+			outside += e;
+	}
+	return 10*log10(outside/total);
+}
+
+//Width of the middle 80% of the energy of x over [start, end), in samples
+static double Spread(const std::vector<float> &x, long start, long end)
+{
+	start = std::max(start, 0L);
+	end = std::min(end, (long)x.size());
+	double total = 0;
+	for (long i=start; i<end; i++)
+		total += (double)x[i]*x[i];
+	if (total <= 0)
+		return 0;
+	double acc = 0;
+	long t10 = start, t90 = start;
+	for (long i=start; i<end; i++)
+	{
+		acc += (double)x[i]*x[i];
+		if (acc < 0.1*total)
+			t10 = i;
+		if (acc < 0.9*total)
+			t90 = i;
+	}
+	return t90 - t10;
+}
+
+static std::vector<Signal> Signals(double samplerate, long length)
+{
+	std::vector<Signal> signals;
+	const double sines[] = {82.41, 329.63, 1318.5};
+	for (int i=0; i<3; i++)
+	{
+		Signal s = {"sine", std::vector<float>(length), {sines[i]}, {}};
+		for (long t=0; t<length; t++)
+			s.x[t] = (float)(0.5*sin(2*M_PI*sines[i]*t/samplerate));
+		signals.push_back(s);
+	}
+
+	//An open E power chord and a C major triad
+	const double chords[2][3] = {{82.41, 123.47, 164.81}, {261.63, 329.63, 392.0}};
+	for (int c=0; c<2; c++)
+	{
+		Signal s = {"chord", std::vector<float>(length), {chords[c][0], chords[c][1], chords[c][2]}, {}};
+		for (long t=0; t<length; t++)
+			for (int i=0; i<3; i++)
+				s.x[t] += (float)(0.2*sin(2*M_PI*chords[c][i]*t/samplerate + i));
+		signals.push_back(s);
+	}
+
+	//Karplus-Strong plucks of a low E and a G, the partials are the harmonics of the string
+	const double plucks[] = {82.41, 196.0};
+	unsigned seed = 1;
+	for (int i=0; i<2; i++)
+	{
+		Signal s = {"pluck", std::vector<float>(length), {}, {}};
+		int period = (int)lround(samplerate/plucks[i]);
+		std::vector<double> line(period);
+		for (int k=0; k<period; k++)
+		{
+			seed = seed*1103515245 + 12345;
+			line[k] = ((seed >> 16) & 0x7fff)/16384.0 - 1.0;
+		}
+		for (long t=0; t<length; t++)
+		{
+			int k = t % period;
+			s.x[t] = (float)(0.5*line[k]);
+			line[k] = 0.996*0.5*(line[k] + line[(k + 1) % period]);
+		}
+		double f0 = samplerate/(period + 0.5); //The averaging adds half a sample to the loop
+		for (double f=f0; f<samplerate/2; f+=f0)
+			s.partials.push_back(f);
+		signals.push_back(s);
+	}
+
+	//Clicks of 1 ms every 250 ms, a decaying burst of 2 kHz
+	Signal s = {"clicks", std::vector<float>(length), {}, {}};
+	long every = (long)(0.25*samplerate), burst = (long)(0.001*samplerate);
+	for (long start=every/2; start+every<=length; start+=every)
+	{
+		s.onsets.push_back(start);
+		for (long t=0; t<burst; t++)
+			s.x[start + t] = (float)(0.8*exp(-4.0*t/burst)*sin(2*M_PI*2000.0*t/samplerate));
+	}
+	signals.push_back(s);
+	return signals;
+}
+
+//Shifts x by semitones through an engine built for the setting, returns Delay() and adds the time spent to cpu
+static int Render(const Metrics &m, double samplerate, uint32_t hop, const std::vector<float> &x, double semitones,
+                  std::vector<float> &y, double *cpu)
+{
+	int nBuffers = nBuffersMs(hop, samplerate, kFrameMs[m.frame]);
+	int window = m.window ? ASYMMETRIC_WINDOW : HANN_WINDOW;
+	Arena arena;
+	arena.Reserve(PSAnalysis::ArenaSize(hop, nBuffers, window) + PSSinthesis::ArenaSize(hop, nBuffers));
+	PSAnalysis a(hop, nBuffers, window, &arena, "");
+	PSSinthesis s(&a, &arena, "");
+	s.SetSynthesis(m.synthesis);
+	s.resampler->quality = m.quality;
+
+	y.assign(x.size(), 0.0f);
+	std::vector<float> in(hop);
+	int cont = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (size_t t=0; t+hop<=x.size(); t+=hop)
+	{
+		memcpy(in.data(), &x[t], hop*sizeof(float));
+		a.PreAnalysis(nBuffers, in.data());
+		s.PreSinthesis();
+		if (cont < nBuffers - 1)
+		{
+			cont++;
+			continue;
+		}
+		a.Analysis(NULL);
+		s.Sinthesis(semitones, NULL);
+		for (uint32_t i=0; i<hop; i++)
+			y[t + i] = (float)s.yshift[i];
+	}
+	*cpu += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return s.Delay();
+}
+
+static Metrics Evaluate(Metrics m, double samplerate, uint32_t hop, const std::vector<Signal> &signals)
+{
+	double cents = 0, dist = 0, smear = 0, cpu = 0;
+	int ncents = 0, ndist = 0, nsmear = 0;
+	long length = signals[0].x.size();
+	std::vector<float> y;
+	int delay = 0;
+
+	for (int k=0; k<kShifts_n; k++)
+	{
+		double ratio = pow(2.0, kShifts[k]/12.0);
+		for (size_t i=0; i<signals.size(); i++)
+		{
+			const Signal &sig = signals[i];
+			delay = Render(m, samplerate, hop, sig.x, kShifts[k], y, &cpu);
+
+			if (sig.onsets.empty())
+			{
+				//The end of the output, well past the frames that were filling up
+				long at = length - SPECTRUM;
+				double f_in = Pitch(&sig.x[at - delay], SPECTRUM, samplerate, 0, samplerate/2);
+				double f = Pitch(&y[at], SPECTRUM, samplerate, f_in*ratio/pow(2.0, 1/12.0), f_in*ratio*pow(2.0, 1/12.0));
+				cents += std::min(fabs(1200*log2(f/(f_in*ratio))), 100.0);
+				ncents++;
+
+				std::vector<double> shifted(sig.partials);
+				for (size_t p=0; p<shifted.size(); p++)
+					shifted[p] *= ratio;
+				dist += Distortion(&y[at], SPECTRUM, shifted, samplerate);
+				ndist++;
+			}
+			else
+			{
+				//Each click is looked for from 50 ms before to 150 ms after it should arrive
+				long before = (long)(0.05*samplerate), after = (long)(0.15*samplerate);
+				for (size_t c=1; c<sig.onsets.size(); c++)
+				{
+					long t = sig.onsets[c] + delay;
+					if (t + after > length)
+						break;
+					smear += (Spread(y, t - before, t + after) - Spread(sig.x, sig.onsets[c] - before, sig.onsets[c] + after))*1000/samplerate;
+					nsmear++;
+				}
+			}
+		}
+	}
+
+	m.cents = cents/std::max(ncents, 1);
+	m.dist = dist/std::max(ndist, 1);
+	m.smear = smear/std::max(nsmear, 1);
+	m.latency = delay*1000/samplerate;
+	m.cpu = 100*cpu/(kShifts_n*signals.size()*length/samplerate);
+	return m;
+}
+
+static bool Dominates(const Metrics &a, const Metrics &b)
+{
+	bool le = a.cpu <= b.cpu && a.latency <= b.latency && a.cents <= b.cents && a.dist <= b.dist && a.smear <= b.smear;
+	bool lt = a.cpu < b.cpu || a.latency < b.latency || a.cents < b.cents || a.dist < b.dist || a.smear < b.smear;
+	return le && lt;
+}
+
+static void Print(const Metrics &m, double samplerate)
+{
+	printf("%5u %7.3f %5d  %-5s %-9s %-7s %7.2f %7.1f %7.2f %8.2f %6.2f\n", m.block, kFrameMs[m.frame], nBuffersMs(m.block, samplerate, kFrameMs[m.frame])*m.block,
+	       kWindows[m.window], kSyntheses[m.synthesis], kInterpolations[m.quality], m.cents, m.dist, m.smear, m.latency, m.cpu);
+}
+
+//Whether frame g gives more hops than frame f at every block size
+static bool Longer(int f, int g, double samplerate, const std::vector<uint32_t> &blocks)
+{
+	for (size_t b=0; b<blocks.size(); b++)
+		if (nBuffersMs(blocks[b], samplerate, kFrameMs[g]) <= nBuffersMs(blocks[b], samplerate, kFrameMs[f]))
+			return false;
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	double samplerate = (argc > 1) ? atof(argv[1]) : 48000.0;
+	std::vector<uint32_t> blocks;
+	for (int i=2; i<argc; i++)
+		blocks.push_back(atoi(argv[i]));
+	if (blocks.empty())
+		blocks = {64, 128, 256};
+	bool valid = samplerate >= 8000;
+	for (size_t b=0; b<blocks.size(); b++)
+		valid = valid && blocks[b] >= 16;
+	if (!valid)
+	{
+		fprintf(stderr, "usage: ricochet-evaluate [samplerate] [block...]\n");
+		return 2;
+	}
+
+	printf("FFT: %s\n", fftwf_version);
+	if (strncmp(fftwf_version, "fftw-", 5) != 0)
+		fprintf(stderr, "warning: the FFT is not FFTW, the cpu column and the presets chosen on it don't hold for the plugin\n");
+	const char *header = "block    ms frame  window synthesis interp    cents    dist   smear  latency    cpu\n";
+	printf("%s", header);
+	std::vector<Metrics> all;
+	for (size_t b=0; b<blocks.size(); b++)
+	{
+		uint32_t hop = blocks[b];
+		std::vector<Signal> signals = Signals(samplerate, (long)(0.75*samplerate/hop)*hop);
+		for (int f=0; f<kFrames; f++)
+			for (int w=0; w<2; w++)
+				for (int s=STANDARD_SYNTHESIS; s<=SINUSOIDAL_SYNTHESIS; s++)
+					for (int q=LINEAR_INTERPOLATION; q<=SINC_INTERPOLATION; q++)
+					{
+						Metrics m = {f, hop, w, s, q, 0, 0, 0, 0, 0};
+						all.push_back(Evaluate(m, samplerate, hop, signals));
+						Print(all.back(), samplerate);
+						fflush(stdout);
+					}
+	}
+
+	//Settings are only compared at the same block size, the host chooses it and not the user
+	printf("\nPareto front of cpu, latency, cents, dist and smear:\n%s", header);
+	for (size_t i=0; i<all.size(); i++)
+	{
+		bool dominated = false;
+		for (size_t j=0; j<all.size() && !dominated; j++)
+			dominated = all[j].block == all[i].block && Dominates(all[j], all[i]);
+		if (!dominated)
+			Print(all[i], samplerate);
+	}
+
+	//Fidelity only sets the frame length, the other settings are controls of their own. Each frame length is
+	//scored by its mean over them and the block sizes, and those that are no better in pitch or distortion than a
+	//cheaper one are dropped. The presets span the rest from the shortest to the longest, each one the cheapest to
+	//reach a distortion evenly spaced in dB between the two and longer in hops than the one before at every block size
+	std::vector<Metrics> mean(kFrames);
+	for (int f=0; f<kFrames; f++)
+	{
+		Metrics m = {f, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+		int n = 0;
+		for (size_t i=0; i<all.size(); i++)
+			if (all[i].frame == f)
+			{
+				m.cents += all[i].cents;
+				m.dist += all[i].dist;
+				m.smear += all[i].smear;
+				m.latency += all[i].latency;
+				m.cpu += all[i].cpu;
+				n++;
+			}
+		m.cents /= n;
+		m.dist /= n;
+		m.smear /= n;
+		m.latency /= n;
+		m.cpu /= n;
+		mean[f] = m;
+	}
+
+	std::vector<int> candidates;
+	for (int f=0; f<kFrames; f++)
+	{
+		bool worse = false;
+		for (int g=0; g<kFrames && !worse; g++)
+			worse = mean[g].cpu < mean[f].cpu && mean[g].cents <= mean[f].cents && mean[g].dist <= mean[f].dist;
+		if (!worse)
+			candidates.push_back(f);
+	}
+	std::sort(candidates.begin(), candidates.end(), [&](int a, int b) { return mean[a].cpu < mean[b].cpu; });
+
+	std::vector<int> presets;
+	if (!candidates.empty())
+	{
+		double first = mean[candidates.front()].dist, last = mean[candidates.back()].dist;
+		presets.push_back(candidates.front());
+		for (int p=1; p<PRESETS; p++)
+		{
+			double target = first + (last - first)*p/(PRESETS - 1);
+			for (size_t c=0; c<candidates.size(); c++)
+			{
+				int f = candidates[c];
+				if (mean[f].dist <= target + 1e-9 && mean[f].cpu > mean[presets.back()].cpu &&
+				    Longer(presets.back(), f, samplerate, blocks))
+				{
+					presets.push_back(f);
+					break;
+				}
+			}
+		}
+	}
+
+	printf("\nMean of each frame length over the other settings and the block sizes:\n");
+	printf("   ms  hops at");
+	for (size_t b=0; b<blocks.size(); b++)
+		printf(" %4u", blocks[b]);
+	printf("             cents    dist   smear  latency    cpu\n");
+	for (int f=0; f<kFrames; f++)
+	{
+		printf("%7.3f        ", kFrameMs[f]);
+		for (size_t b=0; b<blocks.size(); b++)
+			printf(" %4d", nBuffersMs(blocks[b], samplerate, kFrameMs[f]));
+		printf("  %-9s %7.2f %7.1f %7.2f %8.2f %6.2f\n",
+		       std::find(presets.begin(), presets.end(), f) != presets.end() ? "preset" :
+		       std::find(candidates.begin(), candidates.end(), f) != candidates.end() ? "" : "dominated",
+		       mean[f].cents, mean[f].dist, mean[f].smear, mean[f].latency, mean[f].cpu);
+	}
+
+	//Two presets with the same hops at some block size would build the same engine there
+	bool increasing = (int)presets.size() == PRESETS;
+	for (size_t p=1; p<presets.size(); p++)
+		increasing = increasing && Longer(presets[p-1], presets[p], samplerate, blocks);
+	if (!increasing)
+	{
+		fprintf(stderr, "\nno %d frame lengths with more hops than the one before at every block size\n", PRESETS);
+		return 1;
+	}
+
+	printf("\nSuggested kFidelityFrameMs:");
+	for (size_t p=0; p<presets.size(); p++)
+		printf(" %.3f", kFrameMs[presets[p]]);
+	printf("\n");
+	return 0;
+}
@@ -0,0 +1,274 @@
+// Small LV2 host shared by the test drivers: loads the plugin and runs instances on buffers of their own, with
+// the worker run either after each block on the calling thread or by one thread for every instance
+
+#ifndef TOOLS_HOST_H
+#define TOOLS_HOST_H
+
+#include <stdio.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <lv2/lv2plug.in/ns/lv2core/lv2.h>
+#include <lv2/lv2plug.in/ns/ext/atom/atom.h>
+#include <lv2/lv2plug.in/ns/ext/buf-size/buf-size.h>
+#include <lv2/lv2plug.in/ns/ext/midi/midi.h>
+#include <lv2/lv2plug.in/ns/ext/options/options.h>
+#include <lv2/lv2plug.in/ns/ext/urid/urid.h>
+#include <lv2/lv2plug.in/ns/ext/worker/worker.h>
+
+//Ports of the plugin, as in src/Ricochet.cpp
+enum {IN, OUT, TRIGGER, MODE, INTERVAL, DIRECTION, SHIFT_TIME, RETURN_TIME, CLEAN, WET_GAIN, FIDELITY, TRUE_BYPASS, DECIMATE, LATENCY,
+      WINDOW, SYNTHESIS, INTERPOLATION, CONTROL, TRANSIENTS, RECORDER, SPIKE_BUDGET, DUMP, THREADS, PLUGIN_PORT_COUNT};
+
+//Defaults of Ricochet.ttl
+static const float kPortDefaults[PLUGIN_PORT_COUNT] = {0, 0, 0, 0, 3, 1, 0.2f, 0.2f, 0, 3, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 80, 0, 1};
+
+static std::vector<std::string> uris;
+static std::mutex uris_lock;
+
+static LV2_URID map(LV2_URID_Map_Handle handle, const char *uri)
+{
+	std::lock_guard<std::mutex> guard(uris_lock);
+	for (size_t i=0; i<uris.size(); i++)
+		if (uris[i] == uri)
+			return i + 1;
+	uris.push_back(uri);
+	return uris.size();
+}
+
+static LV2_URID_Map urid_map = {NULL, map};
+
+struct Plugin
+{
+	const LV2_Descriptor *d;
+	const LV2_Worker_Interface *worker;
+	std::string bundle; //The directory of the binary, for the wisdom file
+};
+
+static bool LoadPlugin(const char *path, Plugin *plugin)
+{
+	void *lib = dlopen(path, RTLD_NOW);
+	if (!lib)
+	{
+		fprintf(stderr, "%s\n", dlerror());
+		return false;
+	}
+	LV2_Descriptor_Function descriptor = (LV2_Descriptor_Function)dlsym(lib, "lv2_descriptor");
+	plugin->d = descriptor ? descriptor(0) : NULL;
+	if (!plugin->d)
+	{
+		fprintf(stderr, "%s: no LV2 plugin\n", path);
+		return false;
+	}
+	plugin->worker = plugin->d->extension_data ? (const LV2_Worker_Interface*)plugin->d->extension_data(LV2_WORKER__interface) : NULL;
+
+	plugin->bundle = path;
+	size_t slash = plugin->bundle.rfind('/');
+	plugin->bundle = (slash == std::string::npos) ? "." : plugin->bundle.substr(0, slash);
+	return true;
+}
+
+class Instance;
+
+//A worker thread serving many instances, as hosts have
+class WorkerThread
+{
+public:
+	WorkerThread() : quit(false), thread(&WorkerThread::Loop, this) {}
+	~WorkerThread()
+	{
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			quit = true;
+		}
+		wake.notify_one();
+		thread.join();
+	}
+	void Push(Instance *instance, uint32_t size, const void *data)
+	{
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			queue.push_back(Job{instance, std::vector<char>((const char*)data, (const char*)data + size)});
+		}
+		wake.notify_one();
+	}
+
+private:
+	struct Job
+	{
+		Instance *instance;
+		std::vector<char> data;
+	};
+	void Loop();
+
+	std::mutex lock;
+	std::condition_variable wake;
+	std::deque<Job> queue;
+	bool quit;
+	std::thread thread;
+};
+
+//An instance with its own audio and control buffers. Blocks of up to max_block samples are run on in and out,
+//which are the same buffer when in_place is set
+class Instance
+{
+public:
+	Instance(const Plugin &plugin, double samplerate, int32_t max_block, bool worker, WorkerThread *thread = NULL, bool in_place = false)
+		: plugin(plugin), thread(thread), in(max_block), out(max_block), pending(0), block_length(max_block)
+	{
+		output = in_place ? in.data() : out.data();
+		memcpy(values, kPortDefaults, sizeof(values));
+		schedule.handle = this;
+		schedule.schedule_work = Schedule;
+		options[0] = {LV2_OPTIONS_INSTANCE, 0, map(NULL, LV2_BUF_SIZE__maxBlockLength), sizeof(int32_t), map(NULL, LV2_ATOM__Int), &block_length};
+		options[1] = {LV2_OPTIONS_INSTANCE, 0, 0, 0, 0, NULL};
+		map_feature = {LV2_URID__map, &urid_map};
+		options_feature = {LV2_OPTIONS__options, options};
+		schedule_feature = {LV2_WORKER__schedule, &schedule};
+		const LV2_Feature *features[] = {&map_feature, &options_feature, (worker && plugin.worker) ? &schedule_feature : NULL, NULL};
+
+		control = (LV2_Atom_Sequence*)sequence;
+		control->atom.type = map(NULL, LV2_ATOM__Sequence);
+		control->atom.size = sizeof(LV2_Atom_Sequence_Body);
+		control->body.unit = 0;
+		control->body.pad = 0;
+		midi_event = map(NULL, LV2_MIDI__MidiEvent);
+
+		handle = plugin.d->instantiate(plugin.d, samplerate, plugin.bundle.c_str(), features);
+		if (!handle)
+			return;
+		for (int p=0; p<PLUGIN_PORT_COUNT; p++)
+			plugin.d->connect_port(handle, p, &values[p]);
+		plugin.d->connect_port(handle, IN, in.data());
+		plugin.d->connect_port(handle, OUT, output);
+		plugin.d->connect_port(handle, CONTROL, control);
+		plugin.d->activate(handle);
+	}
+
+	~Instance()
+	{
+		if (!handle)
+			return;
+		plugin.d->deactivate(handle);
+		plugin.d->cleanup(handle);
+	}
+
+	//Adds a MIDI message of up to 3 bytes to the next block, at frame
+	void Midi(uint32_t frame, uint8_t status, uint8_t data1, uint8_t data2)
+	{
+		if (sizeof(LV2_Atom) + control->atom.size + sizeof(LV2_Atom_Event) + 8 > sizeof(sequence))
+			return;
+		uint8_t *end = sequence + sizeof(LV2_Atom) + control->atom.size;
+		LV2_Atom_Event *ev = (LV2_Atom_Event*)end;
+		ev->time.frames = frame;
+		ev->body.type = midi_event;
+		ev->body.size = 3;
+		uint8_t *msg = end + sizeof(LV2_Atom_Event);
+		msg[0] = status;
+		msg[1] = data1;
+		msg[2] = data2;
+		control->atom.size += sizeof(LV2_Atom_Event) + 8;
+	}
+
+	//Runs a block. Replies of the worker thread are delivered first, work scheduled without one is done after
+	//the block on this thread, as a host without a worker thread would. MIDI added since the last block is sent
+	//with it
+	void Run(uint32_t n_samples)
+	{
+		Respond();
+		plugin.d->run(handle, n_samples);
+		control->atom.size = sizeof(LV2_Atom_Sequence_Body);
+		if (!thread)
+		{
+			for (size_t i=0; i<requests.size(); i++)
+				Work(requests[i].size(), requests[i].data());
+			requests.clear();
+			Respond();
+		}
+	}
+
+	//Work that gets no reply is no longer pending once it is done
+	void Work(uint32_t size, const void *data)
+	{
+		replied = false;
+		plugin.worker->work(handle, Reply, this, size, data);
+		if (!replied)
+			pending--;
+	}
+
+	const Plugin &plugin;
+	LV2_Handle handle;
+	float values[PLUGIN_PORT_COUNT];
+	WorkerThread *thread;
+	std::vector<float> in, out;
+	float *output; //Where the output of a block is, out or in
+	std::atomic<int> pending; //Work scheduled and not done or answered yet
+
+private:
+	static LV2_Worker_Status Schedule(LV2_Worker_Schedule_Handle handle, uint32_t size, const void *data)
+	{
+		Instance *instance = (Instance*)handle;
+		instance->pending++;
+		if (instance->thread)
+			instance->thread->Push(instance, size, data);
+		else
+			instance->requests.push_back(std::vector<char>((const char*)data, (const char*)data + size));
+		return LV2_WORKER_SUCCESS;
+	}
+
+	static LV2_Worker_Status Reply(LV2_Worker_Respond_Handle handle, uint32_t size, const void *data)
+	{
+		Instance *instance = (Instance*)handle;
+		instance->replied = true;
+		std::lock_guard<std::mutex> guard(instance->lock);
+		instance->replies.push_back(std::vector<char>((const char*)data, (const char*)data + size));
+		return LV2_WORKER_SUCCESS;
+	}
+
+	void Respond()
+	{
+		std::vector<std::vector<char> > ready;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			ready.swap(replies);
+		}
+		for (size_t i=0; i<ready.size(); i++)
+			plugin.worker->work_response(handle, ready[i].size(), ready[i].data());
+		pending -= ready.size();
+	}
+
+	int32_t block_length;
+	LV2_Options_Option options[2];
+	LV2_Worker_Schedule schedule;
+	LV2_Feature map_feature, options_feature, schedule_feature;
+	alignas(8) uint8_t sequence[sizeof(LV2_Atom_Sequence) + 64*(sizeof(LV2_Atom_Event) + 8)]; //Up to 64 events
+	LV2_Atom_Sequence *control; //In sequence
+	LV2_URID midi_event;
+	std::mutex lock;
+	std::vector<std::vector<char> > requests, replies;
+	bool replied; //Set by Reply during Work, both on the thread doing the work
+};
+
+inline void WorkerThread::Loop()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	while (true)
+	{
+		wake.wait(guard, [this] { return quit || !queue.empty(); });
+		if (queue.empty())
+			return;
+		Job job = queue.front();
+		queue.pop_front();
+		guard.unlock();
+		job.instance->Work(job.data.size(), job.data.data());
+		guard.lock();
+	}
+}
+
+#endif
@@ -0,0 +1,100 @@
+// In-place check: runs the same session through an instance with separate input and output buffers and through one
+// where the host hands over the same buffer for both, and compares the outputs bit for bit. The session engages and
+// releases the trigger under true bypass, so the crossfades that read the input after the output is written are
+// covered, and is run at 48 kHz and at 96 kHz with Decimate. The dry mix reads the input behind the interpolation
+// taps, so it is also run under the Hann window with the cubic and sinc interpolations, where the taps reach furthest
+// back. Build this and the plugin with -fsanitize=address to see reads outside of the buffers. Returns 1 if any output
+// differs or is not finite.
+// Usage: ricochet-inplace <ricochet.so> [seconds]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <memory>
+#include "host.h"
+
+struct Session
+{
+	double samplerate;
+	int block;
+	bool decimate;
+	int interpolation;
+};
+
+static const char *kInterpolations[] = {"linear", "cubic", "sinc"};
+
+//Control values at time t in seconds: the trigger is pressed and released under true bypass, then the dry signal is
+//mixed in and the interval changed, and the last part runs without true bypass
+static void Controls(float *v, double t, const Session &s)
+{
+	double cycle = fmod(t, 1.6);
+	v[TRIGGER] = (cycle >= 0.3 && cycle < 1.0) ? 1 : 0;
+	v[SHIFT_TIME] = 0.1f;
+	v[RETURN_TIME] = 0.1f;
+	v[INTERVAL] = (t < 3.2) ? 5 : 3;
+	v[CLEAN] = (t >= 1.6 && t < 3.2) ? 1 : 0;
+	v[TRUE_BYPASS] = (t < 4.0) ? 1 : 0;
+	v[DECIMATE] = s.decimate ? 1 : 0;
+	v[WINDOW] = 0;
+	v[INTERPOLATION] = s.interpolation;
+}
+
+static void Render(const Plugin &plugin, const Session &s, bool in_place, long length, std::vector<float> &y)
+{
+	Instance instance(plugin, s.samplerate, s.block, true, NULL, in_place);
+	y.assign(length, 0.0f);
+	for (long t=0; t<length; t+=s.block)
+	{
+		int n = (int)std::min((long)s.block, length - t);
+		Controls(instance.values, t/s.samplerate, s);
+		for (int i=0; i<n; i++)
+		{
+			double x = (t + i)/s.samplerate;
+			instance.in[i] = (float)(0.3*sin(2*M_PI*196*x) + 0.1*sin(2*M_PI*392*x) + 0.05*sin(2*M_PI*5000*x));
+		}
+		instance.Run(n);
+		memcpy(&y[t], instance.output, n*sizeof(float));
+	}
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: ricochet-inplace <ricochet.so> [seconds]\n");
+		return 2;
+	}
+	double seconds = (argc > 2) ? atof(argv[2]) : 6.4;
+
+	Plugin plugin;
+	if (!LoadPlugin(argv[1], &plugin))
+		return 2;
+
+	const Session sessions[] = {{48000, 128, false, 0}, {96000, 256, true, 0}, {48000, 128, false, 1}, {48000, 128, false, 2}};
+	int failures = 0;
+	for (size_t k=0; k<sizeof(sessions)/sizeof(sessions[0]); k++)
+	{
+		const Session &s = sessions[k];
+		long length = (long)(seconds*s.samplerate);
+		std::vector<float> separate, aliased;
+		Render(plugin, s, false, length, separate);
+		Render(plugin, s, true, length, aliased);
+
+		long differ = 0, first = -1;
+		for (long t=0; t<length; t++)
+			if (memcmp(&separate[t], &aliased[t], sizeof(float)) != 0 || !std::isfinite(separate[t]))
+			{
+				if (first < 0)
+					first = t;
+				differ++;
+			}
+		printf("%.0f Hz, %d samples, %s%s: ", s.samplerate, s.block, kInterpolations[s.interpolation], s.decimate ? ", Decimate" : "");
+		if (differ)
+			printf("%ld of %ld samples differ or are not finite, the first at %.3f s\n", differ, length, first/s.samplerate);
+		else
+			printf("identical over %ld samples\n", length);
+		failures += (differ != 0);
+	}
+	return failures ? 1 : 0;
+}
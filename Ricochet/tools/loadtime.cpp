@@ -0,0 +1,132 @@
+// Load time of the plugin: how long instantiate() and activate() take per instance with a host that has the LV2
+// worker, where the engine is built after the first run(), and with one that has none, where instantiate() builds
+// it. With the worker the build itself is timed too, from the first run() to the reply, for every Fidelity setting.
+// Then a note is held through a change of Fidelity and released in the block where the rebuild is pending, and the
+// trigger must release: with true bypass the output has to be the input again once the pitch has returned. Returns 1
+// if it does not.
+// Usage: ricochet-loadtime <ricochet.so> [instances] [samplerate] [block]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <memory>
+#include "host.h"
+
+static const char *kFidelities[] = {"Lo-Fi", "Medium", "High", "Hi-Fi", "Ultra", "Insane"};
+
+static double Ms(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+//Mean time of instantiate() and activate() over the instances after the first, which also pays for what the
+//process shares
+static void Instantiate(const Plugin &plugin, int n, double samplerate, int block, bool worker, double *first, double *rest,
+                        std::vector<std::unique_ptr<Instance> > *instances)
+{
+	*rest = 0;
+	for (int i=0; i<n; i++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		instances->emplace_back(new Instance(plugin, samplerate, block, worker));
+		double ms = Ms(start);
+		if (i == 0)
+			*first = ms;
+		else
+			*rest += ms;
+	}
+	*rest /= std::max(n - 1, 1);
+}
+
+//Runs seconds of a sine through the instance, sample t onwards
+static void Tone(Instance &instance, double samplerate, int block, double seconds, long *t)
+{
+	for (long end=*t + (long)(seconds*samplerate); *t<end; *t+=block)
+	{
+		for (int i=0; i<block; i++)
+			instance.in[i] = (float)(0.3*sin(2*M_PI*220.0*(*t + i)/samplerate));
+		instance.Run(block);
+	}
+}
+
+//Holds a note on an engine built at Fidelity from, then changes it to to and releases the note in the same block.
+//That block only schedules the rebuild, so the note off arrives while the engine is away
+static bool ReleasedDuringRebuild(const Plugin &plugin, double samplerate, int block, int from, int to)
+{
+	Instance instance(plugin, samplerate, block, true);
+	instance.values[FIDELITY] = from;
+	long t = 0;
+	Tone(instance, samplerate, block, 0.2, &t);
+	instance.Midi(0, 0x90, 60, 100);
+	Tone(instance, samplerate, block, 0.3, &t);
+	instance.values[FIDELITY] = to;
+	instance.Midi(block/2, 0x80, 60, 0);
+	Tone(instance, samplerate, block, 0.6, &t);
+	return memcmp(instance.output, instance.in.data(), block*sizeof(float)) == 0;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: ricochet-loadtime <ricochet.so> [instances] [samplerate] [block]\n");
+		return 2;
+	}
+	int n = (argc > 2) ? atoi(argv[2]) : 16;
+	double samplerate = (argc > 3) ? atof(argv[3]) : 48000.0;
+	int block = (argc > 4) ? atoi(argv[4]) : 128;
+	if (n < 2 || samplerate <= 0 || block <= 0)
+	{
+		fprintf(stderr, "at least 2 instances, and a positive sample rate and block size\n");
+		return 2;
+	}
+
+	Plugin plugin;
+	if (!LoadPlugin(argv[1], &plugin))
+		return 2;
+	if (!plugin.worker)
+	{
+		fprintf(stderr, "%s: the plugin has no worker interface\n", argv[1]);
+		return 2;
+	}
+
+	printf("%d instances at %.0f Hz, blocks of %d samples\n", n, samplerate, block);
+	double first, rest;
+	{
+		std::vector<std::unique_ptr<Instance> > instances;
+		Instantiate(plugin, n, samplerate, block, false, &first, &rest, &instances);
+		printf("without worker: instantiate+activate %8.3f ms per instance (first %.3f ms), the default Fidelity built in it\n", rest, first);
+	}
+
+	std::vector<std::unique_ptr<Instance> > instances;
+	Instantiate(plugin, n, samplerate, block, true, &first, &rest, &instances);
+	printf("with worker:    instantiate+activate %8.3f ms per instance (first %.3f ms), then built by the worker:\n", rest, first);
+
+	//The first run() schedules the build, the host here does the work and delivers the reply right after it
+	for (int f=0; f<6; f++)
+	{
+		double total = 0;
+		for (int i=0; i<n; i++)
+		{
+			Instance &instance = *instances[i];
+			instance.values[FIDELITY] = f;
+			auto start = std::chrono::steady_clock::now();
+			instance.Run(block);
+			total += Ms(start);
+		}
+		printf("  %-7s %8.3f ms per instance\n", kFidelities[f], total/n);
+	}
+
+	int failures = 0;
+	printf("note off while the engine is rebuilt:\n");
+	for (int f=0; f<6; f++)
+	{
+		int to = (f + 3) % 6;
+		bool released = ReleasedDuringRebuild(plugin, samplerate, block, f, to);
+		printf("  %-7s to %-7s %s\n", kFidelities[f], kFidelities[to], released ? "released" : "stuck");
+		failures += !released;
+	}
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,112 @@
+// Offline driver for the flight recorder: loads the plugin, replays a dump through it and checks that every block
+// gives the recorded output. Usage: ricochet-replay <ricochet.so> <dump.rcfr> [output.raw]
+
+#include <stdio.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <string>
+#include <vector>
+#include <lv2/lv2plug.in/ns/lv2core/lv2.h>
+#include <lv2/lv2plug.in/ns/ext/atom/atom.h>
+#include <lv2/lv2plug.in/ns/ext/buf-size/buf-size.h>
+#include <lv2/lv2plug.in/ns/ext/options/options.h>
+#include <lv2/lv2plug.in/ns/ext/urid/urid.h>
+#include "FlightRecorder.h"
+
+static std::vector<std::string> uris;
+
+static LV2_URID map(LV2_URID_Map_Handle handle, const char *uri)
+{
+	for (size_t i=0; i<uris.size(); i++)
+		if (uris[i] == uri)
+			return i + 1;
+	uris.push_back(uri);
+	return uris.size();
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 3)
+	{
+		fprintf(stderr, "usage: %s <ricochet.so> <dump.rcfr> [output.raw]\n", argv[0]);
+		return 2;
+	}
+
+	FILE *f = fopen(argv[2], "rb");
+	RecorderHeader h;
+	if (!f || fread(&h, sizeof(h), 1, f) != 1 || h.magic != RECORDER_MAGIC || h.version != RECORDER_VERSION)
+	{
+		fprintf(stderr, "%s: not a flight recorder dump\n", argv[2]);
+		return 2;
+	}
+
+	//The slowest block is usually the reason for the dump
+	fseek(f, h.state_bytes + h.arena_bytes, SEEK_CUR);
+	std::vector<RecorderBlock> blocks(h.nblocks);
+	if (fread(blocks.data(), sizeof(RecorderBlock), h.nblocks, f) != h.nblocks)
+	{
+		fprintf(stderr, "%s: truncated dump\n", argv[2]);
+		return 2;
+	}
+	fclose(f);
+
+	uint32_t slowest = 0;
+	for (uint32_t b=0; b<h.nblocks; b++)
+		if (blocks[b].dsp_ns > blocks[slowest].dsp_ns)
+			slowest = b;
+	printf("%u blocks, %.2f s at %.0f Hz%s\n", h.nblocks, h.samples/h.samplerate, h.samplerate,
+	       (h.flags & RECORDER_INCOMPLETE) ? ", MIDI events were lost so the replay is not exact" : "");
+	if (h.nblocks)
+		printf("slowest block %u at %.3f s: %.1f us, %.1f us more recording it, semitone %.3f\n", slowest,
+		       slowest*(double)h.max_block/h.samplerate, blocks[slowest].dsp_ns*1e-3, blocks[slowest].record_ns*1e-3, blocks[slowest].semitone);
+
+	void *lib = dlopen(argv[1], RTLD_NOW);
+	if (!lib)
+	{
+		fprintf(stderr, "%s\n", dlerror());
+		return 2;
+	}
+	LV2_Descriptor_Function descriptor = (LV2_Descriptor_Function)dlsym(lib, "lv2_descriptor");
+	const LV2_Descriptor *d = descriptor ? descriptor(0) : NULL;
+	if (!d)
+	{
+		fprintf(stderr, "%s: no LV2 plugin\n", argv[1]);
+		return 2;
+	}
+
+	//The bundle is the directory of the binary, for the wisdom file
+	std::string bundle = argv[1];
+	size_t slash = bundle.rfind('/');
+	bundle = (slash == std::string::npos) ? "." : bundle.substr(0, slash);
+
+	LV2_URID_Map urid_map = {NULL, map};
+	int32_t block_length = h.max_block;
+	LV2_Options_Option options[] = {
+		{LV2_OPTIONS_INSTANCE, 0, map(NULL, LV2_BUF_SIZE__maxBlockLength), sizeof(int32_t), map(NULL, LV2_ATOM__Int), &block_length},
+		{LV2_OPTIONS_INSTANCE, 0, 0, 0, 0, NULL}
+	};
+	LV2_Feature map_feature = {LV2_URID__map, &urid_map};
+	LV2_Feature options_feature = {LV2_OPTIONS__options, options};
+	const LV2_Feature *features[] = {&map_feature, &options_feature, NULL};
+
+	LV2_Handle instance = d->instantiate(d, h.samplerate, bundle.c_str(), features);
+	const RecorderReplay *replay = d->extension_data ? (const RecorderReplay*)d->extension_data(RECORDER_REPLAY_URI) : NULL;
+	if (!instance || !replay)
+	{
+		fprintf(stderr, "%s: the plugin can't replay dumps\n", argv[1]);
+		return 2;
+	}
+
+	d->activate(instance);
+	int mismatches = replay->replay(instance, argv[2], (argc > 3) ? argv[3] : NULL);
+	d->deactivate(instance);
+	d->cleanup(instance);
+
+	if (mismatches < 0)
+	{
+		fprintf(stderr, "%s: the dump doesn't match this plugin build or sample rate\n", argv[2]);
+		return 2;
+	}
+	printf("%d of %u blocks differ from the recording\n", mismatches, h.nblocks);
+	return (mismatches == 0) ? 0 : 1;
+}
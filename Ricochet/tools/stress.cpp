@@ -0,0 +1,169 @@
+// Stress test: runs 1 to 64 instances across audio threads while every instance keeps changing its Fidelity and
+// block size, and reports how throughput scales with the threads. With the worker done after each block every
+// instance must give the same output as when it runs alone, a difference means instances share state they
+// shouldn't. With -w one worker thread serves every instance as in a host, the output then depends on when the
+// engine comes back and is only checked to be finite, and blocks run while an engine is being rebuilt (passed
+// through) are counted as waiting. The Threads of each instance change too, so the bins are split over helper pools
+// that come and go. Build this and the plugin with -fsanitize=thread to look for races.
+// Usage: ricochet-stress [-w] <ricochet.so> [instances] [threads] [seconds]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <chrono>
+#include <memory>
+#include "host.h"
+
+#define SAMPLE_RATE 48000.0
+#define MAX_BLOCK 256
+#define BINPOOL_THREADS 4 //Threads of the helper pool, BINPOOL_MAX_THREADS of Shared_files/BinPool.h
+
+//Settings of instance i at block b. Each instance has its own sequence of changes so the engines are rebuilt at
+//different times, and the block size changes on its own schedule
+static uint32_t Configure(Instance &instance, int i, int b)
+{
+	float *v = instance.values;
+	v[TRIGGER] = ((b / 40) % 2 == 0) ? 1 : 0;
+	v[INTERVAL] = i % 7;
+	v[SHIFT_TIME] = 0.05f;
+	v[RETURN_TIME] = 0.05f;
+	v[TRUE_BYPASS] = i % 2;
+	v[DECIMATE] = (i / 2) % 2;
+	v[WINDOW] = (i / 4) % 2;
+	v[SYNTHESIS] = (i / 8) % 3;
+	v[THREADS] = 1 + (b / (30 + i) + i) % BINPOOL_THREADS;
+	v[FIDELITY] = ((b / (50 + i)) % 2 == 0) ? i % 6 : (i + 3) % 6;
+	return ((b / (70 + 2*i)) % 2 == 0) ? MAX_BLOCK : MAX_BLOCK / 2;
+}
+
+static uint64_t Hash(uint64_t h, const float *x, uint32_t n)
+{
+	for (uint32_t k=0; k<n; k++)
+	{
+		uint32_t bits;
+		memcpy(&bits, &x[k], sizeof(bits));
+		h = (h ^ bits) * 1099511628211ULL;
+	}
+	return h;
+}
+
+struct Result
+{
+	uint64_t hash;
+	bool finite;
+	long waiting; //Blocks run while the worker had not answered
+};
+
+//Runs instances [first, end) block by block, the input of each one a tone of its own
+static void Run(std::vector<std::unique_ptr<Instance> > &instances, int first, int end, int blocks, Result *results)
+{
+	for (int i=first; i<end; i++)
+	{
+		results[i].hash = 14695981039346656037ULL;
+		results[i].finite = true;
+		results[i].waiting = 0;
+	}
+	std::vector<long> t(end - first, 0);
+	for (int b=0; b<blocks; b++)
+		for (int i=first; i<end; i++)
+		{
+			Instance &instance = *instances[i];
+			uint32_t n = Configure(instance, i, b);
+			double f = 110.0 * (1 + i % 5);
+			for (uint32_t k=0; k<n; k++, t[i-first]++)
+				instance.in[k] = (float)(0.3 * sin(2*M_PI*f*t[i-first]/SAMPLE_RATE));
+			instance.Run(n);
+			results[i].hash = Hash(results[i].hash, instance.output, n);
+			for (uint32_t k=0; k<n; k++)
+				results[i].finite = results[i].finite && std::isfinite(instance.output[k]);
+			results[i].waiting += (instance.pending > 0);
+		}
+}
+
+int main(int argc, char **argv)
+{
+	bool worker_thread = (argc > 1 && strcmp(argv[1], "-w") == 0);
+	if (worker_thread)
+	{
+		argc--;
+		argv++;
+	}
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: ricochet-stress [-w] <ricochet.so> [instances] [threads] [seconds]\n");
+		return 2;
+	}
+	int max_instances = (argc > 2) ? atoi(argv[2]) : 64;
+	int max_threads = (argc > 3) ? atoi(argv[3]) : std::max((int)std::thread::hardware_concurrency(), 1);
+	double seconds = (argc > 4) ? atof(argv[4]) : 1.0;
+	int blocks = (int)(seconds * SAMPLE_RATE / MAX_BLOCK);
+	if (max_instances < 1 || max_instances > 64 || max_threads < 1 || blocks < 1)
+	{
+		fprintf(stderr, "instances go from 1 to 64, and threads and seconds must be positive\n");
+		return 2;
+	}
+
+	Plugin plugin;
+	if (!LoadPlugin(argv[1], &plugin))
+		return 2;
+
+	//Each instance alone on this thread gives the reference output
+	std::vector<Result> reference(max_instances);
+	if (!worker_thread)
+	{
+		for (int i=0; i<max_instances; i++)
+		{
+			std::vector<std::unique_ptr<Instance> > alone(i + 1);
+			alone[i].reset(new Instance(plugin, SAMPLE_RATE, MAX_BLOCK, true));
+			Run(alone, i, i + 1, blocks, reference.data());
+		}
+	}
+
+	printf("%d blocks of up to %d samples per instance, worker %s\n", blocks, MAX_BLOCK, worker_thread ? "thread" : "after each block");
+	printf("instances threads   blocks/s  scaling  waiting  mismatches\n");
+	int failures = 0;
+	for (int n=1; n<=max_instances; n = (n == max_instances) ? n + 1 : std::min(n * 4, max_instances))
+	{
+		double single = 0.0;
+		for (int threads=1; threads<=max_threads; threads = (threads == max_threads) ? threads + 1 : std::min(threads * 2, max_threads))
+		{
+			if (threads > n)
+				break;
+			std::unique_ptr<WorkerThread> worker(worker_thread ? new WorkerThread : NULL);
+			std::vector<std::unique_ptr<Instance> > instances(n);
+			for (int i=0; i<n; i++)
+				instances[i].reset(new Instance(plugin, SAMPLE_RATE, MAX_BLOCK, true, worker.get()));
+			std::vector<Result> results(n);
+
+			auto start = std::chrono::steady_clock::now();
+			std::vector<std::thread> audio;
+			for (int a=0; a<threads; a++)
+				audio.emplace_back(Run, std::ref(instances), n*a/threads, n*(a + 1)/threads, blocks, results.data());
+			for (size_t a=0; a<audio.size(); a++)
+				audio[a].join();
+			double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+			//The worker is stopped before the instances it may still be working for
+			worker.reset();
+			instances.clear();
+
+			int mismatches = 0;
+			long waiting = 0;
+			for (int i=0; i<n; i++)
+			{
+				waiting += results[i].waiting;
+				if (!results[i].finite || (!worker_thread && results[i].hash != reference[i].hash))
+					mismatches++;
+			}
+			failures += mismatches;
+
+			double rate = (double)n * blocks / elapsed;
+			if (threads == 1)
+				single = rate;
+			printf("%9d %7d %10.0f %7.2fx %7.1f%% %11d\n", n, threads, rate, rate / single, 100.0 * waiting / ((double)n * blocks), mismatches);
+		}
+	}
+	return failures ? 1 : 0;
+}
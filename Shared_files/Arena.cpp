@@ -0,0 +1,59 @@
+#include <string.h>
+#include <new>
+#include "Arena.h"
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+Arena::Arena() //Constructor
+{
+	base = NULL;
+	size = 0;
+	used = 0;
+}
+
+Arena::~Arena() //Destructor
+{
+	free(base);
+}
+
+void Arena::Reserve(size_t bytes)
+{
+	used = 0;
+	if (bytes <= size)
+		return;
+
+	free(base);
+	base = NULL;
+	size = 0;
+
+	//Blocks of a huge page or more are aligned to it so the kernel can back them with huge pages
+	size_t align = ARENA_ALIGN;
+	if (bytes >= HUGE_PAGE)
+	{
+		align = HUGE_PAGE;
+		bytes = (bytes + HUGE_PAGE - 1) & ~(size_t)(HUGE_PAGE - 1);
+	}
+
+	void *p = NULL;
+	if (posix_memalign(&p, align, bytes) != 0)
+		throw std::bad_alloc();
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+	if (align == HUGE_PAGE)
+		madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+	base = (char*)p;
+	size = bytes;
+}
+
+void *Arena::Take(size_t bytes)
+{
+	bytes = Bytes<char>(bytes);
+	if (used + bytes > size)
+		throw std::bad_alloc();
+
+	void *p = base + used;
+	used += bytes;
+	memset(p, 0, bytes);
+	return p;
+}
@@ -0,0 +1,28 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#define ARENA_ALIGN 64 //Cache line
+#define HUGE_PAGE (2*1024*1024)
+
+//A single block holding the DSP buffers of an instance. Buffers are handed out in the order they are
+//taken, so taking them in processing order keeps the data of a hop close together
+class Arena
+{
+public:
+	Arena();
+	~Arena();
+	void Reserve(size_t bytes); //Rewinds, and reallocates only if the block has to grow
+	void *Take(size_t bytes); //Zeroed and ARENA_ALIGN aligned
+
+	template <class T> T *Take(size_t n) {return (T*)Take(sizeof(T)*n);}
+	template <class T> static size_t Bytes(size_t n) {return (sizeof(T)*n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);}
+
+	char *base;
+	size_t size;
+	size_t used;
+};
+
+#endif
@@ -0,0 +1,175 @@
+#include <pthread.h>
+#include <sched.h>
+#include <errno.h>
+#include <system_error>
+#include <algorithm>
+#include "BinPool.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CPU_RELAX() _mm_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#define CPU_RELAX() __asm__ __volatile__("yield")
+#else
+#define CPU_RELAX()
+#endif
+
+#define BINPOOL_SPINS 4096 //Polls of an idle helper between yields of its core
+
+BinPool::BinPool(int helpers, int policy, int priority) //Construtor
+	: helpers(0), awake(false), quit(false), work(0), done(0), jobs(0), job(NULL), ctx(NULL), n(0)
+{
+	for (int i=0; i<BINPOOL_MAX_THREADS - 1; i++)
+	{
+		sem_init(&wake[i], 0, 0);
+		parked[i].store(false);
+	}
+
+	//Spinning threads only help while each one has a core of its own. A helper that can't be started just
+	//leaves the pool smaller
+	int cores = (int)std::thread::hardware_concurrency();
+	helpers = std::min(helpers, BINPOOL_MAX_THREADS - 1);
+	if (cores > 0)
+		helpers = std::min(helpers, cores - 1);
+
+	for (int i=0; i<helpers; i++)
+	{
+		try
+		{
+			threads.emplace_back(&BinPool::Loop, this, i, policy, priority);
+		}
+		catch (const std::system_error&)
+		{
+			break;
+		}
+		this->helpers++;
+	}
+}
+
+BinPool::~BinPool() //Destrutor
+{
+	quit.store(true);
+	awake.store(false);
+	for (size_t i=0; i<threads.size(); i++)
+		sem_post(&wake[i]);
+	for (size_t i=0; i<threads.size(); i++)
+		threads[i].join();
+	for (int i=0; i<BINPOOL_MAX_THREADS - 1; i++)
+		sem_destroy(&wake[i]);
+}
+
+//Called by the audio thread before the hops of a block, so the helpers are up by the time the first loop is split.
+//Only a helper that has parked is posted, one still spinning from the last block just carries on
+void BinPool::Wake()
+{
+	awake.store(true, std::memory_order_seq_cst);
+	for (int i=0; i<helpers; i++)
+		if (parked[i].exchange(false, std::memory_order_seq_cst))
+			sem_post(&wake[i]);
+}
+
+//Called after the last loop of a block, the helpers go back to sleep once they see it
+void BinPool::Park()
+{
+	awake.store(false, std::memory_order_release);
+}
+
+//First bin of a part, on a 16 bin boundary so two threads never write to the same cache line
+int BinPool::Start(int part, int parts, int n)
+{
+	if (part >= parts)
+		return n;
+	return (int)((long long)n*part/parts) & ~15;
+}
+
+//Takes the next part of the job, false once they are all taken. A part can only be taken while its job is running,
+//so job, ctx and n are those of the part
+bool BinPool::Claim(int *part, int *parts)
+{
+	uint64_t w = work.load(std::memory_order_acquire);
+	while ((w & 0xffff) < ((w >> 16) & 0xffff))
+	{
+		if (work.compare_exchange_weak(w, w + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+		{
+			*part = (int)(w & 0xffff);
+			*parts = (int)((w >> 16) & 0xffff);
+			return true;
+		}
+	}
+	return false;
+}
+
+void BinPool::Work(int part, int parts)
+{
+	job(ctx, Start(part, parts, n), Start(part + 1, parts, n));
+	done.fetch_add(1, std::memory_order_release);
+}
+
+//The caller takes parts too, so the job is finished even by helpers that are still asleep
+void BinPool::Run(int n, BinJob job, void *ctx)
+{
+	int p = std::min(helpers + 1, n/BINPOOL_GRAIN);
+	if (p <= 1)
+	{
+		job(ctx, 0, n);
+		return;
+	}
+
+	this->job = job;
+	this->ctx = ctx;
+	this->n = n;
+	done.store(0, std::memory_order_relaxed);
+	work.store((uint64_t)++jobs << 32 | (uint64_t)p << 16, std::memory_order_release);
+
+	int part, parts;
+	while (Claim(&part, &parts))
+		Work(part, parts);
+
+	int spins = 0;
+	while (done.load(std::memory_order_acquire) != p)
+	{
+		CPU_RELAX();
+		if (++spins == BINPOOL_SPINS)
+		{
+			spins = 0;
+			std::this_thread::yield();
+		}
+	}
+}
+
+//Helpers run at the priority of the audio thread that asked for them, when the system allows it
+void BinPool::Loop(int index, int policy, int priority)
+{
+	sched_param param;
+	param.sched_priority = priority;
+	pthread_setschedparam(pthread_self(), policy, &param);
+
+	while (true)
+	{
+		//Parked first and awake checked after, so a Wake in between either sees the flag and posts, or is seen
+		//here and the flag is taken back
+		parked[index].store(true, std::memory_order_seq_cst);
+		if (!(awake.load(std::memory_order_seq_cst) && parked[index].exchange(false, std::memory_order_seq_cst)))
+			while (sem_wait(&wake[index]) != 0 && errno == EINTR);
+		if (quit.load())
+			return;
+
+		int spins = 0;
+		while (awake.load(std::memory_order_acquire))
+		{
+			int part, parts;
+			if (Claim(&part, &parts))
+			{
+				Work(part, parts);
+				spins = 0;
+				continue;
+			}
+			CPU_RELAX();
+			if (++spins == BINPOOL_SPINS)
+			{
+				spins = 0;
+				std::this_thread::yield();
+			}
+		}
+	}
+}
@@ -0,0 +1,63 @@
+#ifndef BINPOOL_H
+#define BINPOOL_H
+
+#include <stdint.h>
+#include <semaphore.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#define BINPOOL_MAX_THREADS 4 //Threads a hop may be split across, the caller included
+#define BINPOOL_GRAIN 128 //Fewest bins a thread is given, smaller loops run on the caller alone
+
+typedef void (*BinJob)(void *ctx, int start, int end);
+
+//Helper threads that take ranges of bins, so a loop of one hop is split across cores and joined before the caller
+//goes on, with no latency added. The helpers sleep until Wake, spin waiting for work until Park, and are started
+//and stopped outside of the audio thread
+class BinPool
+{
+public:
+	BinPool(int helpers, int policy, int priority);
+	~BinPool();
+	void Wake();
+	void Park();
+	void Run(int n, BinJob job, void *ctx);
+
+	//Calls f(start, end) on consecutive ranges of [0, n)
+	template <class F> void Split(int n, F &f)
+	{
+		Run(n, [](void *ctx, int start, int end) { (*(F*)ctx)(start, end); }, &f);
+	}
+
+	int helpers; //Threads besides the caller
+
+private:
+	void Loop(int index, int policy, int priority);
+	bool Claim(int *part, int *parts);
+	void Work(int part, int parts);
+	int Start(int part, int parts, int n);
+
+	std::vector<std::thread> threads;
+	sem_t wake[BINPOOL_MAX_THREADS - 1]; //Posted by Wake for a helper that has parked
+	std::atomic<bool> parked[BINPOOL_MAX_THREADS - 1]; //The helper is waiting on its semaphore, or about to
+	std::atomic<bool> awake;
+	std::atomic<bool> quit;
+	std::atomic<uint64_t> work; //Job number, parts of the job and next part to take, 32, 16 and 16 bits
+	std::atomic<int> done; //Parts of the job finished
+	uint32_t jobs;
+	BinJob job;
+	void *ctx;
+	int n;
+};
+
+//Runs f(start, end) on the pool, or on [0, n) at once when there is none
+template <class F> void SplitBins(BinPool *pool, int n, F f)
+{
+	if (pool)
+		pool->Split(n, f);
+	else
+		f(0, n);
+}
+
+#endif
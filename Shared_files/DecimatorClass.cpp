@@ -0,0 +1,111 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include "DecimatorClass.h"
+
+//max_delay is the longest delay of the processing between Down and Up, in host rate samples
+DecimatorClass::DecimatorClass(uint32_t n_samples, int factor, int max_delay, Arena *arena) //Constructor
+{
+	N = (int)n_samples;
+	this->factor = factor;
+	M = N/factor;
+	taps = 32*factor + 1;
+	D = (taps - 1)/2;
+	hist = (taps + factor - 1)/factor;
+	hlen = max_delay + D + N;
+
+	h = arena->Take<float>(taps);
+	xbuf = arena->Take<float>(taps - 1 + N);
+	high = arena->Take<float>(hlen);
+	ubuf = arena->Take<float>(hist + M);
+
+	//Blackman windowed sinc. Its transition is about 5.5/(taps - 1) wide, the cutoff is half of it below the decimated
+	//Nyquist so the stopband, over 70 dB down, starts there and nothing aliases. The band left out of it is kept dry
+	double fc = 0.5/factor - 2.75/(taps - 1);
+	for (int k=0; k<taps; k++)
+	{
+		double t = k - D;
+		double sinc = (t == 0) ? 2*fc : sin(2*M_PI*fc*t)/(M_PI*t);
+		double w = 0.42 - 0.5*cos(2*M_PI*k/(taps - 1)) + 0.08*cos(4*M_PI*k/(taps - 1));
+		h[k] = sinc*w;
+	}
+
+	Clear();
+}
+
+DecimatorClass::~DecimatorClass(){} //Destructor, the buffers belong to the arena
+
+size_t DecimatorClass::ArenaSize(uint32_t n_samples, int factor, int max_delay)
+{
+	int taps = 32*factor + 1;
+	int M = n_samples/factor;
+	int hist = (taps + factor - 1)/factor;
+	return Arena::Bytes<float>(taps) + Arena::Bytes<float>(taps - 1 + n_samples) + Arena::Bytes<float>(max_delay + (taps - 1)/2 + n_samples) +
+	       Arena::Bytes<float>(hist + M);
+}
+
+void DecimatorClass::Clear()
+{
+	memset(xbuf, 0, sizeof(float)*(taps - 1 + N));
+	memset(high, 0, sizeof(float)*hlen);
+	hpos = 0;
+	hblock = 0;
+	memset(ubuf, 0, sizeof(float)*(hist + M));
+}
+
+void DecimatorClass::Down(const float *in, float *low)
+{
+	memcpy(&xbuf[taps - 1], in, sizeof(float)*N);
+
+	//The lowpass is evaluated at every sample so the complementary high band is exact
+	int w = hblock = hpos;
+	for (int n=0; n<N; n++)
+	{
+		const float *x = &xbuf[n + taps - 1];
+		float lp = 0;
+		for (int k=0; k<taps; k++)
+			lp += h[k]*x[-k];
+		high[w] = x[-D] - lp;
+		if (++w == hlen)
+			w = 0;
+		if (n % factor == 0)
+			low[n/factor] = lp;
+	}
+
+	memmove(xbuf, &xbuf[N], sizeof(float)*(taps - 1));
+	hpos = w;
+}
+
+//delay is that of the processing of the low band since Down, in host rate samples. The high band is held back by
+//it plus the D of the interpolation filter, so both bands come out aligned
+void DecimatorClass::Up(const float *low, float *out, int delay)
+{
+	memcpy(&ubuf[hist], low, sizeof(float)*M);
+
+	delay = std::min(std::max(delay, 0) + D, hlen - N);
+	int r = hblock - delay;
+	if (r < 0)
+		r += hlen;
+
+	//Polyphase interpolation: only the taps that hit a non-zero (non stuffed) sample are evaluated
+	for (int n=0; n<N; n++)
+	{
+		float y = 0;
+		for (int k = n % factor; k<taps; k += factor)
+			y += h[k]*ubuf[hist + (n - k)/factor];
+		out[n] = factor*y + high[r];
+		if (++r == hlen)
+			r = 0;
+	}
+
+	memmove(ubuf, &ubuf[M], sizeof(float)*hist);
+}
+
+int DecimationFactor(double samplerate)
+{
+	if (samplerate >= 4*44100.0)
+		return 4;
+	if (samplerate >= 2*44100.0)
+		return 2;
+	return 1;
+}
@@ -0,0 +1,31 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include "Arena.h"
+
+class DecimatorClass
+{
+public:
+	DecimatorClass(uint32_t n_samples, int factor, int max_delay, Arena *arena);
+	~DecimatorClass();
+	static size_t ArenaSize(uint32_t n_samples, int factor, int max_delay);
+	void Down(const float *in, float *low);
+	void Up(const float *low, float *out, int delay);
+	void Clear();
+
+	int N; //Block size at the host rate
+	int M; //Block size at the decimated rate
+	int factor; //Decimation factor
+	int taps; //Length of the anti-aliasing/anti-imaging filter
+	int D; //Group delay of the filter, in host rate samples
+	int hist; //Decimated rate history needed by Up
+	int hlen; //Length of the high band delay line, the longest delay plus a block
+	int hpos; //Where Down writes next in the delay line
+	int hblock; //Where the block of the last Down starts
+
+	float *h; //Windowed-sinc lowpass whose stopband starts at the decimated Nyquist
+	float *xbuf; //Last taps-1 input samples followed by the current block
+	float *high; //Delay line of the input minus its lowpassed version, added back dry by Up
+	float *ubuf; //Last hist decimated samples followed by the current decimated block
+};
+
+int DecimationFactor(double samplerate);
@@ -1,13 +0,0 @@
-#include <complex>
-#include <cmath>
-
-#define ONEOVERTWOPI 0.159154943091895335768
-#define TWOPI 6.28318530717958647692
-
-#define FOUROVERPI 1.27323954473516268615
-#define NEGFOUROVERPISQ -0.40528473456935108577
-
-using namespace std;
-
-void ExponencialComplexa( double x, complex<double> * target);
-
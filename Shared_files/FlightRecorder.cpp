@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <string.h>
+#include <new>
+#include "FlightRecorder.h"
+
+FlightRecorder::FlightRecorder(double samplerate, uint32_t max_block, int ncontrols, size_t state_bytes, size_t arena_bytes) //Constructor
+{
+	this->samplerate = samplerate;
+	this->max_block = max_block;
+	this->ncontrols = ncontrols;
+	this->state_bytes = state_bytes;
+	this->arena_bytes = arena_bytes;
+
+	//Two segments. Blocks down to half of max_block still fill a whole segment, smaller ones start the next one sooner
+	size_t segment = (size_t)(RECORDER_SECONDS*samplerate);
+	nsamples = 2*(segment + max_block);
+	nblocks = 2*(2*segment/max_block + 2);
+	nevents = 2*RECORDER_EVENTS;
+
+	blocks = (RecorderBlock*)calloc(nblocks, sizeof(RecorderBlock));
+	controls = (float*)calloc(nblocks*ncontrols, sizeof(float));
+	events = (RecorderEvent*)calloc(nevents, sizeof(RecorderEvent));
+	audio = (float*)calloc(nsamples, sizeof(float));
+	for (int k=0; k<2; k++)
+	{
+		slot[k].state = (char*)calloc(state_bytes, 1);
+		slot[k].arena = (char*)malloc(arena_bytes);
+	}
+
+	if (!blocks || !controls || !events || !audio || !slot[0].state || !slot[0].arena || !slot[1].state || !slot[1].arena)
+	{
+		this->~FlightRecorder();
+		throw std::bad_alloc();
+	}
+
+	block = 0;
+	event = 0;
+	sample = 0;
+	newest = 0;
+	Restart();
+}
+
+FlightRecorder::~FlightRecorder() //Destructor
+{
+	free(blocks);
+	free(controls);
+	free(events);
+	free(audio);
+	for (int k=0; k<2; k++)
+	{
+		free(slot[k].state);
+		free(slot[k].arena);
+	}
+}
+
+/*
+Called at the start of every block. When the current segment is long enough, or the next block would not fit in
+its half of the rings, the arena is copied into the older slot, which becomes the newest checkpoint. The caller then
+fills the returned state, NULL means no checkpoint was taken.
+*/
+char *FlightRecorder::Checkpoint(const char *arena, size_t used, uint32_t n_samples)
+{
+	Slot &s = slot[newest];
+	bool due = !s.valid || sample - s.sample >= (uint64_t)(RECORDER_SECONDS*samplerate) ||
+	           sample - s.sample + n_samples > nsamples/2 || block - s.block + 1 > nblocks/2;
+	if (!due)
+		return NULL;
+
+	if (used > arena_bytes || n_samples > max_block)
+	{
+		Restart();
+		return NULL;
+	}
+
+	Slot &c = slot[1 - newest];
+	c.valid = true;
+	c.dropped = false;
+	c.block = block;
+	c.event = event;
+	c.sample = sample;
+	c.used = used;
+	memcpy(c.arena, arena, used);
+	newest = 1 - newest;
+	return c.state;
+}
+
+void FlightRecorder::Begin(const float *in, uint32_t n_samples, const float *controls)
+{
+	if (!slot[newest].valid)
+		return;
+
+	RecorderBlock &b = blocks[block % nblocks];
+	memset(&b, 0, sizeof(b));
+	b.n_samples = n_samples;
+	memcpy(&this->controls[(block % nblocks)*ncontrols], controls, sizeof(float)*ncontrols);
+
+	size_t at = sample % nsamples;
+	size_t first = (n_samples < nsamples - at) ? n_samples : nsamples - at;
+	memcpy(&audio[at], in, sizeof(float)*first);
+	memcpy(audio, in + first, sizeof(float)*(n_samples - first));
+	sample += n_samples;
+}
+
+void FlightRecorder::Event(uint32_t frame, const uint8_t *msg, uint32_t size)
+{
+	if (!slot[newest].valid)
+		return;
+
+	if (event - slot[newest].event >= nevents/2 || size > 3)
+	{
+		slot[newest].dropped = true;
+		return;
+	}
+
+	RecorderEvent &e = events[event % nevents];
+	e.frame = frame;
+	e.size = (uint8_t)size;
+	memset(e.data, 0, sizeof(e.data));
+	memcpy(e.data, msg, size);
+	blocks[block % nblocks].nevents++;
+	event++;
+}
+
+void FlightRecorder::End(const float *out, uint32_t dsp_ns, uint32_t record_ns, double semitone, double ramp_position, double ramp_target, double ramp_samples_remaining)
+{
+	if (!slot[newest].valid)
+		return;
+
+	RecorderBlock &b = blocks[block % nblocks];
+	b.dsp_ns = dsp_ns;
+	b.record_ns = record_ns;
+	b.out_hash = Hash(out, b.n_samples);
+	b.semitone = semitone;
+	b.ramp_position = ramp_position;
+	b.ramp_target = ramp_target;
+	b.ramp_samples_remaining = ramp_samples_remaining;
+	block++;
+}
+
+//Whether a whole segment of history is held
+bool FlightRecorder::Full()
+{
+	return slot[0].valid && slot[1].valid;
+}
+
+//Drops the history, the next block takes a new checkpoint
+void FlightRecorder::Restart()
+{
+	for (int k=0; k<2; k++)
+	{
+		slot[k].valid = false;
+		slot[k].dropped = false;
+	}
+	busy = false;
+}
+
+//Writes everything from the oldest checkpoint on. Called by the worker while busy keeps the audio thread away
+bool FlightRecorder::Write(const char *path)
+{
+	const Slot &o = slot[Full() ? 1 - newest : newest];
+	if (!o.valid)
+		return false;
+
+	FILE *f = fopen(path, "wb");
+	if (!f)
+		return false;
+
+	RecorderHeader h;
+	memset(&h, 0, sizeof(h));
+	h.magic = RECORDER_MAGIC;
+	h.version = RECORDER_VERSION;
+	h.samplerate = samplerate;
+	h.max_block = max_block;
+	h.ncontrols = ncontrols;
+	h.nblocks = (uint32_t)(block - o.block);
+	h.nevents = (uint32_t)(event - o.event);
+	h.state_bytes = (uint32_t)state_bytes;
+	h.arena_bytes = (uint32_t)o.used;
+	h.samples = sample - o.sample;
+	h.flags = (slot[0].valid && slot[0].dropped) || (slot[1].valid && slot[1].dropped) ? RECORDER_INCOMPLETE : 0;
+
+	//Ranges of the rings, split where they wrap
+	bool ok = true;
+	auto ring = [&](const void *data, size_t size, size_t capacity, uint64_t start, uint64_t count)
+	{
+		size_t at = start % capacity;
+		size_t first = (count < capacity - at) ? count : capacity - at;
+		ok = ok && fwrite((const char*)data + at*size, size, first, f) == first;
+		ok = ok && fwrite(data, size, count - first, f) == count - first;
+	};
+
+	ok = ok && fwrite(&h, sizeof(h), 1, f) == 1;
+	ok = ok && fwrite(o.state, 1, state_bytes, f) == state_bytes;
+	ok = ok && fwrite(o.arena, 1, o.used, f) == o.used;
+	ring(blocks, sizeof(RecorderBlock), nblocks, o.block, h.nblocks);
+	ring(controls, sizeof(float)*ncontrols, nblocks, o.block, h.nblocks);
+	ring(events, sizeof(RecorderEvent), nevents, o.event, h.nevents);
+	ring(audio, sizeof(float), nsamples, o.sample, h.samples);
+
+	return (fclose(f) == 0) && ok;
+}
+
+//FNV-1a over the bits of the samples
+uint32_t FlightRecorder::Hash(const float *x, uint32_t n)
+{
+	uint32_t h = 2166136261u;
+	for (uint32_t i=0; i<n; i++)
+	{
+		uint32_t bits;
+		memcpy(&bits, &x[i], sizeof(bits));
+		h = (h ^ bits)*16777619u;
+	}
+	return h;
+}
@@ -0,0 +1,113 @@
+#ifndef FLIGHTRECORDER_H
+#define FLIGHTRECORDER_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#define RECORDER_SECONDS 5 //Length of a segment, a dump holds between one and two of them
+#define RECORDER_EVENTS 1024 //MIDI events kept per segment
+#define RECORDER_MAGIC 0x52464352 //"RCFR"
+#define RECORDER_VERSION 2
+#define RECORDER_INCOMPLETE 1 //Flag of a dump that lost MIDI events, its replay is not exact
+
+//Layout of a dump: the header, the state and arena of the checkpoint, then nblocks RecorderBlock, nblocks rows of
+//ncontrols port values, nevents RecorderEvent and the input samples of all the blocks one after another
+//extension_data interface of the plugin that replays a dump through an instance, see tools/replay.cpp. Returns the
+//number of blocks whose output or pitch differ from the recorded ones, or -1 if the dump can't be replayed
+#define RECORDER_REPLAY_URI "https://github.com/theKAOSSphere/ricochet#replay"
+
+struct RecorderReplay
+{
+	int (*replay)(void *instance, const char *dump, const char *output);
+};
+
+struct RecorderHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	double samplerate;
+	uint32_t max_block;
+	uint32_t ncontrols;
+	uint32_t nblocks;
+	uint32_t nevents;
+	uint32_t state_bytes;
+	uint32_t arena_bytes;
+	uint64_t samples;
+	uint32_t flags;
+	uint32_t reserved;
+};
+
+struct RecorderBlock
+{
+	uint32_t n_samples;
+	uint32_t nevents; //MIDI events of the block, they follow the ones of the previous blocks
+	uint32_t dsp_ns; //Time spent processing the block
+	uint32_t out_hash; //FlightRecorder::Hash of the output, checked by the replay
+	uint32_t record_ns; //Time spent recording it before, a checkpoint included
+	uint32_t reserved;
+	double semitone; //Pitch the vocoder ran at
+	double ramp_position; //Ramp state at the end of the block
+	double ramp_target;
+	double ramp_samples_remaining;
+};
+
+struct RecorderEvent
+{
+	uint32_t frame;
+	uint8_t size;
+	uint8_t data[3];
+};
+
+//Keeps the input, the control values and the MIDI of the last seconds of run() together with a checkpoint of the
+//engine taken where they start, so a dump replays bit-exactly. Only the audio thread writes to it, and a dump is
+//written by the worker while the audio thread keeps away from it
+class FlightRecorder
+{
+public:
+	FlightRecorder(double samplerate, uint32_t max_block, int ncontrols, size_t state_bytes, size_t arena_bytes);
+	~FlightRecorder();
+	char *Checkpoint(const char *arena, size_t used, uint32_t n_samples);
+	void Begin(const float *in, uint32_t n_samples, const float *controls);
+	void Event(uint32_t frame, const uint8_t *msg, uint32_t size);
+	void End(const float *out, uint32_t dsp_ns, uint32_t record_ns, double semitone, double ramp_position, double ramp_target, double ramp_samples_remaining);
+	bool Write(const char *path);
+	void Restart();
+	bool Full();
+	static uint32_t Hash(const float *x, uint32_t n);
+
+	struct Slot
+	{
+		bool valid;
+		bool dropped; //Events of the segment starting here were lost
+		uint64_t block; //Counters at the checkpoint
+		uint64_t event;
+		uint64_t sample;
+		size_t used; //Bytes of the arena
+		char *state;
+		char *arena;
+	};
+
+	double samplerate;
+	uint32_t max_block;
+	int ncontrols;
+	size_t state_bytes;
+	size_t arena_bytes; //Largest arena a checkpoint can hold
+	bool busy; //A dump is being written, nothing is recorded until Restart
+
+	Slot slot[2];
+	int newest; //Slot of the last checkpoint
+
+	size_t nblocks; //Capacity of the rings
+	size_t nevents;
+	size_t nsamples;
+	uint64_t block; //Blocks, events and samples recorded so far, the rings are indexed modulo their capacity
+	uint64_t event;
+	uint64_t sample;
+
+	RecorderBlock *blocks;
+	float *controls;
+	RecorderEvent *events;
+	float *audio;
+};
+
+#endif
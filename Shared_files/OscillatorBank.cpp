@@ -0,0 +1,206 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include "OscillatorBank.h"
+#include "phase.h"
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+static int Slots(int capacity)
+{
+	return (2*capacity + 3) & ~3;
+}
+
+OscillatorBank::OscillatorBank(int capacity, int bins, Arena *arena) //Constructor
+{
+	this->capacity = capacity;
+	slots = Slots(capacity);
+	count = 0;
+
+	order = arena->Take<int>(bins);
+	matched = arena->Take<bool>(slots);
+	freq = arena->Take<double>(slots);
+	target = arena->Take<float>(slots);
+	re = arena->Take<float>(slots);
+	im = arena->Take<float>(slots);
+	cr = arena->Take<float>(slots);
+	ci = arena->Take<float>(slots);
+	amp = arena->Take<float>(slots);
+	damp = arena->Take<float>(slots);
+
+	Clear();
+}
+
+OscillatorBank::~OscillatorBank(){} //Destructor, the buffers belong to the arena
+
+size_t OscillatorBank::ArenaSize(int capacity, int bins)
+{
+	int slots = Slots(capacity);
+	return Arena::Bytes<int>(bins) + Arena::Bytes<bool>(slots) + Arena::Bytes<double>(slots) + 7*Arena::Bytes<float>(slots);
+}
+
+void OscillatorBank::Clear()
+{
+	count = 0;
+	memset(target, 0, sizeof(float)*slots);
+	memset(re, 0, sizeof(float)*slots);
+	memset(im, 0, sizeof(float)*slots);
+	memset(cr, 0, sizeof(float)*slots);
+	memset(ci, 0, sizeof(float)*slots);
+	memset(amp, 0, sizeof(float)*slots);
+	memset(damp, 0, sizeof(float)*slots);
+}
+
+/*
+Continues the tracks of the previous hop with the nearest peak in frequency (strongest peaks first), starts new
+tracks from silence for the peaks left over and fades out the tracks that found no peak. ratio scales the analysed
+frequencies to the shifted ones and scale converts the peak magnitudes to amplitudes. With restart no track is
+continued, at an onset every peak starts a new track with its analysed phase while the old ones fade out.
+*/
+void OscillatorBank::Update(const int *bins, int npeaks, const double *mag, const uint32_t *arg, const double *omega, double ratio, double scale, double tolerance, int hop, bool restart)
+{
+	for (int k=0; k<npeaks; k++)
+		order[k] = k;
+	std::sort(order, order + npeaks, [&](int a, int b) { return mag[bins[a]] > mag[bins[b]]; });
+	npeaks = std::min(npeaks, capacity);
+
+	//Peaks below -60 dB of the strongest one are not worth an oscillator
+	double threshold = (npeaks > 0) ? mag[bins[order[0]]]*1e-3 : 0;
+
+	int old = count;
+	for (int j=0; j<old; j++)
+	{
+		matched[j] = false;
+		target[j] = 0;
+	}
+
+	for (int k=0; k<npeaks; k++)
+	{
+		int bin = bins[order[k]];
+		if (mag[bin] < threshold)
+			break;
+
+		double w = omega[bin];
+		int best = -1;
+		double dist = tolerance;
+		for (int j=0; j<old && !restart; j++)
+		{
+			double d = fabs(freq[j] - w);
+			if (!matched[j] && d < dist)
+			{
+				best = j;
+				dist = d;
+			}
+		}
+
+		if (best < 0)
+		{
+			if (count == slots)
+				continue;
+			best = count++;
+			ExponencialComplexa(arg[bin], &re[best], &im[best]);
+			amp[best] = 0;
+		}
+
+		//Parabolic interpolation of the log magnitude recovers the level lost between bins
+		double a = log(mag[bin-1] + 1e-20);
+		double b = log(mag[bin] + 1e-20);
+		double c = log(mag[bin+1] + 1e-20);
+		double den = a - 2*b + c;
+		double p = (den < 0) ? 0.5*(a - c)/den : 0;
+
+		matched[best] = true;
+		freq[best] = w;
+		target[best] = exp(b - 0.25*(a - c)*p)*scale;
+	}
+
+	for (int j=0; j<count; j++)
+	{
+		double w = freq[j]*ratio;
+		if (w >= M_PI)
+			target[j] = 0;
+		cr[j] = cos(w);
+		ci[j] = sin(w);
+		damp[j] = (target[j] - amp[j])/hop;
+	}
+	for (int j=count; j<((count + 3) & ~3); j++)
+	{
+		amp[j] = 0;
+		damp[j] = 0;
+	}
+}
+
+void OscillatorBank::Render(double *out, int n)
+{
+	int m = (count + 3) & ~3;
+
+	for (int i=0; i<n; i++)
+	{
+#if defined(__SSE__)
+		__m128 acc = _mm_setzero_ps();
+		for (int j=0; j<m; j+=4)
+		{
+			__m128 r = _mm_load_ps(&re[j]);
+			__m128 s = _mm_load_ps(&im[j]);
+			__m128 c = _mm_load_ps(&cr[j]);
+			__m128 d = _mm_load_ps(&ci[j]);
+			__m128 a = _mm_load_ps(&amp[j]);
+			acc = _mm_add_ps(acc, _mm_mul_ps(a, s));
+			_mm_store_ps(&re[j], _mm_sub_ps(_mm_mul_ps(r, c), _mm_mul_ps(s, d)));
+			_mm_store_ps(&im[j], _mm_add_ps(_mm_mul_ps(r, d), _mm_mul_ps(s, c)));
+			_mm_store_ps(&amp[j], _mm_add_ps(a, _mm_load_ps(&damp[j])));
+		}
+		float sum[4];
+		_mm_storeu_ps(sum, acc);
+		out[i] = sum[0] + sum[1] + sum[2] + sum[3];
+#elif defined(__ARM_NEON__)
+		float32x4_t acc = vdupq_n_f32(0.0f);
+		for (int j=0; j<m; j+=4)
+		{
+			float32x4_t r = vld1q_f32(&re[j]);
+			float32x4_t s = vld1q_f32(&im[j]);
+			float32x4_t c = vld1q_f32(&cr[j]);
+			float32x4_t d = vld1q_f32(&ci[j]);
+			float32x4_t a = vld1q_f32(&amp[j]);
+			acc = vmlaq_f32(acc, a, s);
+			vst1q_f32(&re[j], vmlsq_f32(vmulq_f32(r, c), s, d));
+			vst1q_f32(&im[j], vmlaq_f32(vmulq_f32(r, d), s, c));
+			vst1q_f32(&amp[j], vaddq_f32(a, vld1q_f32(&damp[j])));
+		}
+		float sum[4];
+		vst1q_f32(sum, acc);
+		out[i] = sum[0] + sum[1] + sum[2] + sum[3];
+#else
+		float acc = 0;
+		for (int j=0; j<m; j++)
+		{
+			float r = re[j];
+			float s = im[j];
+			acc += amp[j]*s;
+			re[j] = r*cr[j] - s*ci[j];
+			im[j] = r*ci[j] + s*cr[j];
+			amp[j] += damp[j];
+		}
+		out[i] = acc;
+#endif
+	}
+
+	//Drop the tracks that faded out and keep the phasors on the unit circle
+	int live = 0;
+	for (int j=0; j<count; j++)
+	{
+		if (target[j] <= 0)
+			continue;
+		float g = 1.0f/sqrtf(re[j]*re[j] + im[j]*im[j]);
+		re[live] = re[j]*g;
+		im[live] = im[j]*g;
+		amp[live] = target[j];
+		target[live] = target[j];
+		freq[live] = freq[j];
+		live++;
+	}
+	count = live;
+}
@@ -0,0 +1,29 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include "Arena.h"
+
+class OscillatorBank
+{
+public:
+	OscillatorBank(int capacity, int bins, Arena *arena);
+	~OscillatorBank();
+	static size_t ArenaSize(int capacity, int bins);
+	void Clear();
+	void Update(const int *bins, int npeaks, const double *mag, const uint32_t *arg, const double *omega, double ratio, double scale, double tolerance, int hop, bool restart);
+	void Render(double *out, int n);
+
+	int capacity; //Maximum number of partials that can be started in one hop
+	int slots; //Allocated oscillators, room for the fading out tracks plus the new ones, multiple of 4
+	int count; //Oscillators in use
+
+	int *order; //Peaks sorted by decreasing magnitude
+	bool *matched; //Whether a track was continued by a peak in the current hop
+	double *freq; //Analysed frequency of each track, radians per sample
+	float *target; //Amplitude to reach at the end of the hop
+	float *re; //Oscillator phasors
+	float *im;
+	float *cr; //Per-sample rotation of the phasors
+	float *ci;
+	float *amp; //Current amplitude
+	float *damp; //Amplitude increment per sample
+};
@@ -9,162 +9,197 @@
 #include <lv2/lv2plug.in/ns/ext/options/options.h>
 
 #define N_SAMPLES_DEFAULT 128
+#define OLA_GUARD 16 //Samples kept in front of the overlap-add region for the resampler taps
+#define FRAME_HISTORY (SINC_TAPS/2) //Samples kept in front of frames, the dry mix is read up to Reach() - 1 before it
 
-PSAnalysis::PSAnalysis(uint32_t n_samples, int nBuffers, const char* wisdomFile) //Construtor
+//Length of ysaida, the frames of a hop may reach a synthesis hop (up to 4*hopa) past the newest one
+static int OlaLength(int N, int Qcolumn, int hopa)
 {
-	Qcolumn = nBuffers;
-	hopa = n_samples;
-	N = nBuffers*n_samples;
-
-	frames = new double[N]; fill_n(frames,N,0);
-	b = new double*[hopa];
-
-	for (int i=0 ; i< nBuffers; i++)
-		b[i] = &frames[i*hopa];
-
-	frames2 = fftwf_alloc_real(N);
-	fXa = fftwf_alloc_complex(N/2 + 1);
-	Xa.zeros(N/2 + 1);
-	XaPrevious.zeros(N/2 + 1);
-	Xa_arg.zeros(N/2 + 1);
-	XaPrevious_arg.zeros(N/2 + 1);
-	d_phi.zeros(N/2 + 1); 
-	d_phi_prime.zeros(N/2 + 1); 
-	d_phi_wrapped.zeros(N/2 + 1); 
-	omega_true_sobre_fs.zeros(N/2 + 1); 
-	AUX.zeros(N/2 + 1); 
-	Xa_abs.zeros(N/2 + 1); 
-	w.zeros(N); hann(N,&w); 
-	I.zeros(N/2 + 1); I = linspace(0, N/2, N/2 + 1);
-
-	if (fftwf_import_system_wisdom() != 0)
-	{
-		p = fftwf_plan_dft_r2c_1d(N, frames2, fXa, FFTW_WISDOM_ONLY|FFTW_ESTIMATE);
-		printf("PSAnalysis: using system wisdom file\n");
-	}
-	else if (fftwf_import_wisdom_from_filename(wisdomFile) != 0)
+	return max(2*N, N + 4*hopa) + 4*(Qcolumn-1)*hopa + 2 + OLA_GUARD;
+}
+
+//The buffers are taken from the arena in the order a hop uses them, the vectors are bound to it
+PSAnalysis::PSAnalysis(uint32_t n_samples, int nBuffers, int window, Arena *arena, const char* wisdomFile) //Construtor
+	: N(nBuffers*n_samples), hopa(n_samples), Qcolumn(nBuffers), window(window),
+	  //Synthesis support of a third of the frame for the asymmetric pair, at least two hops so the overlap-add stays flat
+	  Ns((window == ASYMMETRIC_WINDOW) ? max(2, nBuffers/3)*(int)n_samples : N),
+	  frames(arena->Take<double>(FRAME_HISTORY + N) + FRAME_HISTORY),
+	  w(arena->Take<double>(N), N, false, true),
+	  wshort(arena->Take<double>((window == ASYMMETRIC_WINDOW) ? Ns : 0)),
+	  frames2(arena->Take<float>(N)),
+	  fXa(arena->Take<fftwf_complex>(N/2 + 1)),
+	  Xa_arg(arena->Take<uint32_t>(N/2 + 1)),
+	  Xa_abs(arena->Take<double>(N/2 + 1), N/2 + 1, false, true),
+	  omega_true_sobre_fs(arena->Take<double>(N/2 + 1), N/2 + 1, false, true),
+	  ws(arena->Take<double>(N), N, false, true)
+{
+	if (window == ASYMMETRIC_WINDOW)
 	{
-		p = fftwf_plan_dft_r2c_1d(N, frames2, fXa, FFTW_WISDOM_ONLY|FFTW_ESTIMATE);
-		printf("PSAnalysis: using plugin-provided wisdom file\n");
+		asymmetric(N, Ns/2, &w, &ws);
+		Ew = accu(w % ws)*4.0/3.0;
+
+		//A short frame is the last Ns samples under a Hann, synthesized with a rectangular window. The product
+		//of the two is the same Hann of Ns as in the long frames, so the overlap-add and the delay are unchanged
+		for (int i=0; i<Ns; i++)
+			wshort[i] = 0.5*(1 - cos(2*M_PI*i/Ns));
 	}
 	else
 	{
-		p = fftwf_plan_dft_r2c_1d(N, frames2, fXa, FFTW_ESTIMATE);
-		printf("PSAnalysis: failed to import wisdom file '%s', using estimate instead\n", wisdomFile);
+		hann(N,&w);
+		ws = w;
+		Ew = N/2.0;
 	}
+	Wsum = accu(w);
+	Nc = N - (int)round(accu(w % linspace(0, N-1, N))/Wsum);
+
+	transients = false;
+	fill_n(energy, ONSET_HOPS, 0.0);
+	hold = 0;
+	Na = N;
+	resized = false;
+	reset = false;
+
+	p = plan_r2c(N, frames2, fXa, wisdomFile);
+	pshort = (window == ASYMMETRIC_WINDOW) ? plan_r2c(Ns, frames2, fXa, wisdomFile) : NULL;
 }
 
 PSAnalysis::~PSAnalysis() //Destrutor
 {
-	if (p) fftwf_destroy_plan(p);
-	delete[] b;
-	delete[] frames;
-	fftwf_free(frames2);
-	fftwf_free(fXa);
-	Xa.clear();
-	XaPrevious.clear();
-	Xa_arg.clear();
-	XaPrevious_arg.clear();
-	d_phi.clear(); 
-	d_phi_prime.clear(); 
-	d_phi_wrapped.clear(); 
-	omega_true_sobre_fs.clear(); 
-	AUX.clear(); 
-	Xa_abs.clear(); 
-	w.clear(); 
-	I.clear();
+	destroy_plan(p);
+	destroy_plan(pshort);
+}
+
+size_t PSAnalysis::ArenaSize(uint32_t n_samples, int nBuffers, int window)
+{
+	int N = nBuffers*n_samples;
+	int Ns = (window == ASYMMETRIC_WINDOW) ? max(2, nBuffers/3)*(int)n_samples : 0;
+	return Arena::Bytes<double>(FRAME_HISTORY + N) + 2*Arena::Bytes<double>(N) + Arena::Bytes<double>(Ns) + Arena::Bytes<float>(N) + Arena::Bytes<fftwf_complex>(N/2 + 1) +
+	       Arena::Bytes<uint32_t>(N/2 + 1) + 2*Arena::Bytes<double>(N/2 + 1);
 }
 
 void PSAnalysis::PreAnalysis(int nBuffers, float *in)
 {
+	memmove(frames - FRAME_HISTORY, frames - FRAME_HISTORY + hopa, sizeof(double)*(FRAME_HISTORY + N - hopa));
 	for (int i=0; i<hopa; i++)
-	{
-		for (int j=0; j<(nBuffers-1); j++)
-			b[j][i] = b[j+1][i];
-		b[nBuffers-1][i] = in[i];
-	}
+		frames[N - hopa + i] = in[i];
 }
 
-void PSAnalysis::Analysis()
+/*
+Onsets are found on the input ring, as a jump of the energy of the newest hop over the mean of the hops before it.
+At an onset the synthesis phases restart from the analysis. With the asymmetric windows the analysis also moves to
+short frames until the long frame no longer contains the onset, so the attack is not smeared over the long frame.
+*/
+void PSAnalysis::DetectOnset()
+{
+	double e = 0;
+	for (int i=N-hopa; i<N; i++)
+		e = e + frames[i]*frames[i];
+
+	double mean = 0;
+	for (int k=0; k<ONSET_HOPS; k++)
+		mean = mean + energy[k];
+	mean = mean/ONSET_HOPS;
+
+	for (int k=0; k<ONSET_HOPS-1; k++)
+		energy[k] = energy[k+1];
+	energy[ONSET_HOPS-1] = e;
+
+	bool onset = transients && e > ONSET_RATIO*mean && e > ONSET_FLOOR*hopa;
+	int previous = Na;
+
+	if (onset)
+		hold = (window == ASYMMETRIC_WINDOW) ? Qcolumn : 0;
+	else if (hold > 0)
+		hold--;
+
+	Na = (hold > 0) ? Ns : N;
+	resized = (Na != previous);
+	reset = onset || resized;
+}
+
+void PSAnalysis::Analysis(BinPool *pool)
 {
 	//Starts now
+
+	DetectOnset();
 	
 	//Windowing
 
-	double norm = sqrt( N/(2.0*hopa) );
+	//The loops work on raw pointers with angle() inlined, so they vectorize. A short frame is the last Na samples, and its window energy is the same as the long one
+	double scale = 1/sqrt( Ew/hopa );
+	const double *win = (Na == N) ? w.memptr() : wshort;
+	const double *x = frames + N - Na;
 	
-	for (int i=0; i<N; i++)
-		frames2[i] = frames[i]*w(i)/norm;
+	for (int i=0; i<Na; i++)
+		frames2[i] = x[i]*win[i]*scale;
 	
 	/*Analysis*/
-	if (p) fftwf_execute(p);
+	fftwf_plan plan = (Na == N) ? p : pshort;
+	if (plan) fftwf_execute(plan);
 	
 	/*Processing*/
-	for (int i=0; i<(N/2 + 1); i++)
+	//Deviation of each phase from the expected advance over a hop gives the true frequency. The phases are
+	//fixed point, so the deviation is wrapped to [-pi,pi) by reading the difference as signed.
+	//When the frame size has just changed the previous phases belong to other bins, the bin centres are used.
+	//Bins are independent, the pool may split them across threads
+	double *mag = Xa_abs.memptr();
+	uint32_t *arg = Xa_arg;
+	double *omega = omega_true_sobre_fs.memptr();
+	const double track = resized ? 0 : 1.0/hopa;
+
+	SplitBins(pool, Na/2 + 1, [&](int start, int end)
 	{
-		Xa(i) = cx_float(fXa[i][0], fXa[i][1]);
-		angle(Xa(i), &Xa_arg(i));
-		//Xa_arg(i) = angle(Xa(i));
-	}
-
-	d_phi = Xa_arg - XaPrevious_arg;
-	d_phi_prime = d_phi - ((2*M_PI * hopa) / N) * I;
-	AUX = floor((d_phi_prime + M_PI) / (2*M_PI));
-	d_phi_wrapped = d_phi_prime - AUX * (2*M_PI);
-	omega_true_sobre_fs = (2*M_PI/N) * I + d_phi_wrapped / hopa;
-
-	Xa_abs = abs(Xa);
-	XaPrevious = Xa;
-	XaPrevious_arg = Xa_arg;
+		UnwrapBins(fXa, arg, mag, omega, start, end, Na, hopa, track);
+	});
 }
 
-PSSinthesis::PSSinthesis(PSAnalysis *obj, const char* wisdomFile) //Construtor
+PSSinthesis::PSSinthesis(PSAnalysis *obj, Arena *arena, const char* wisdomFile) //Construtor
+	: N(obj->N), hopa(obj->hopa), Qcolumn(obj->Qcolumn),
+	  peak(arena->Take<int>(N/2 + 1)),
+	  region(arena->Take<int>(N/2 + 1)),
+	  bank(new OscillatorBank(64, N/2 + 1, arena)),
+	  hops(arena->Take<double>(Qcolumn)),
+	  Phi(arena->Take<uint32_t>(N/2 + 1)),
+	  fXs(arena->Take<fftwf_complex>(N/2 + 1)),
+	  q(arena->Take<float>(N)),
+	  ysaida(arena->Take<float>(OlaLength(N, Qcolumn, hopa))),
+	  yshift(arena->Take<double>(hopa))
 {
-	Qcolumn = obj->Qcolumn;
-	hopa = obj->hopa;
-	N = obj->N;
 	omega_true_sobre_fs = &obj->omega_true_sobre_fs;
 	Xa_abs = &obj->Xa_abs;
-	w = &obj->w;
+	Xa_arg = obj->Xa_arg;
+	w = &obj->ws;
+	Ns = obj->Ns;
+	Nc = obj->Nc;
+	Ew = obj->Ew;
+	Wsum = obj->Wsum;
+	analysis = obj;
 
 	first = true;
-	hops = new int[Qcolumn];                       fill_n(hops,Qcolumn,hopa);
-	ysaida = new double[2*N + 4*(Qcolumn-1)*hopa]; fill_n(ysaida,2*N + 4*(Qcolumn-1)*hopa,0);
-	yshift = new double[hopa];                     fill_n(yshift,hopa,0);
-	q = fftwf_alloc_real(N);
-	fXs = fftwf_alloc_complex(N/2 + 1);
-	Xs.zeros(N/2 + 1);
-	Phi.zeros(N/2 + 1);
-	PhiPrevious.zeros(N/2 + 1);
-
-	if (fftwf_import_system_wisdom() != 0)
-	{
-		p2 = fftwf_plan_dft_c2r_1d(N, fXs, q, FFTW_WISDOM_ONLY|FFTW_ESTIMATE);
-		printf("PSSinthesis: using system wisdom file\n");
-	}
-	else if (fftwf_import_wisdom_from_filename(wisdomFile) != 0)
-	{
-		p2 = fftwf_plan_dft_c2r_1d(N, fXs, q, FFTW_WISDOM_ONLY|FFTW_ESTIMATE);
-		printf("PSSinthesis: using plugin-provided wisdom file\n");
-	}
-	else
-	{
-		p2 = fftwf_plan_dft_c2r_1d(N, fXs, q, FFTW_ESTIMATE);
-		printf("PSSinthesis: failed to import wisdom file '%s', using estimate instead\n", wisdomFile);
-	}
+	synthesis = STANDARD_SYNTHESIS;
+	npeaks = 0;
+	frac = 0;
+	fill_n(hops,Qcolumn,(double)hopa);
+	resampler = new Resampler();
+
+	p2 = plan_c2r(N, fXs, q, wisdomFile);
+	p2short = (obj->pshort) ? plan_c2r(Ns, fXs, q, wisdomFile) : NULL;
 }
 
 PSSinthesis::~PSSinthesis() //Destrutor
 {
-	delete[] hops;
-	delete[] ysaida;
-	delete[] yshift;
-	fftwf_free(q);
-	fftwf_free(fXs);
-	Xs.clear();
-	Phi.clear();
-	PhiPrevious.clear();
-	if (p2) fftwf_destroy_plan(p2);
+	delete bank;
+	delete resampler;
+	destroy_plan(p2);
+	destroy_plan(p2short);
+}
+
+size_t PSSinthesis::ArenaSize(uint32_t n_samples, int nBuffers)
+{
+	int N = nBuffers*n_samples;
+	return 2*Arena::Bytes<int>(N/2 + 1) + OscillatorBank::ArenaSize(64, N/2 + 1) + Arena::Bytes<double>(nBuffers) +
+	       Arena::Bytes<uint32_t>(N/2 + 1) + Arena::Bytes<fftwf_complex>(N/2 + 1) + Arena::Bytes<float>(N) +
+	       Arena::Bytes<float>(OlaLength(N, nBuffers, n_samples)) + Arena::Bytes<double>(n_samples);
 }
 
 void PSSinthesis::PreSinthesis()
@@ -179,11 +214,31 @@ void PSSinthesis::ClearYShift()
 
 void PSSinthesis::ClearBuffers()
 {
-    int L = 2 * N + 4 * (Qcolumn - 1) * hopa;
-    memset(ysaida, 0, sizeof(double) * L);
+    int L = OlaLength(N, Qcolumn, hopa);
+    memset(ysaida, 0, sizeof(float) * L);
     first = true;
-    Phi.zeros(N/2 + 1);
-    PhiPrevious.zeros(N/2 + 1);
+    frac = 0;
+    bank->Clear();
+    memset(Phi, 0, sizeof(uint32_t) * (N/2 + 1));
+}
+
+void PSSinthesis::SetSynthesis(int mode)
+{
+	//The overlap-add buffer and the partial tracks are only kept up to date by the mode that uses them
+	bool was_sinusoidal = (synthesis == SINUSOIDAL_SYNTHESIS);
+	bool is_sinusoidal = (mode == SINUSOIDAL_SYNTHESIS);
+	synthesis = mode;
+
+	if (was_sinusoidal != is_sinusoidal)
+		ClearBuffers();
+}
+
+//Delay of yshift relative to the input, in samples
+int PSSinthesis::Delay()
+{
+	if (synthesis == SINUSOIDAL_SYNTHESIS)
+		return Nc;
+	return Ns - hopa + resampler->Reach() - 1;
 }
 
 void PSSinthesis::SetYShiftFromInput(const float* in, int n)
@@ -193,25 +248,49 @@ void PSSinthesis::SetYShiftFromInput(const float* in, int n)
     }
 }
 
-void PSSinthesis::Sinthesis(double s)
+void PSSinthesis::Sinthesis(double s, BinPool *pool)
 {
     //Sinthesis, t1
     
-	hops[Qcolumn-1] = round(hopa*(pow(2,(s/12))));
+	//The synthesis hop is kept fractional so the pitch ratio is exact at any hopa
+	hops[Qcolumn-1] = hopa*(pow(2,(s/12)));
+
+	//Size of the analysed frame, short frames only fill the first Na/2 + 1 bins
+	int Na = analysis->Na;
+	int bins = Na/2 + 1;
+
+	if (synthesis == SINUSOIDAL_SYNTHESIS)
+	{
+		//Oscillator bank at the shifted peak frequencies, no IFFT and no overlap-add. The level matches
+		//the overlap-add modes, whose gain is 3/4*sqrt(hopa/hop). The Hann of a short frame sums to Ns/2
+		npeaks = peaks(Xa_abs[0].memptr(), bins, peak);
+		double scale = 1.5*sqrt(Ew/hops[Qcolumn-1])/((Na == N) ? Wsum : Ns/2.0);
+		bank->Update(peak, npeaks, Xa_abs[0].memptr(), Xa_arg, omega_true_sobre_fs[0].memptr(),
+		             hops[Qcolumn-1]/hopa, scale, 3*M_PI/Na, hopa, analysis->reset);
+		bank->Render(yshift, hopa);
+		return;
+	}
 	
 	//Some declaration
-	int L;
-	L = N;
+	double P; //Start of the newest frame in ysaida, frac is the fractional part of the buffer origin
+	P = OLA_GUARD + frac;
 	for (int i=0; i< Qcolumn-1; i++)
-		L = L + hops[i];
+		P = P + hops[i];
+	int Pi = (int)P;
+	double f = P - Pi;
 	double r;
-	int n1;
-	int n2;
-	double n3;
+
+	//Frames further apart than Ns/3 leave the overlap-add modulated at the hop rate, unless they are no further
+	//apart than the analysis hop (the short asymmetric windows of two hops). A longer synthesis hop is split into
+	//K frames of the same spectrum, a sub-hop apart with their phases advanced by it. Up to unison K is 1
+	const double hop = hops[Qcolumn-1];
+	int K = max(1, (int)ceil(hop/max((double)hopa, Ns/3.0)));
+	double sub = hop/K;
+	int L = (int)(P + (K-1)*sub) + N + 1; //End of the region touched by the frames of this hop
 	
 	//Some inicialization
 	
-	ysaida2 = &ysaida[L-N];
+	ysaida2 = &ysaida[Pi];
 
 	//Sinthesis, t2
 
@@ -220,75 +299,124 @@ void PSSinthesis::Sinthesis(double s)
 	//Sinthesis: //t2-t3 -> //t1-t2: t1 = getticks();
 	//step 2, t1
 
-	Phi = PhiPrevious + (hops[Qcolumn-1])*omega_true_sobre_fs[0] ;
-
-	//Sinthesis: //t2-t3 -> //t1-t2: t2 = getticks();
-	
-	int expCompEnd = N/2 + 1;
-	for (int i=0; i<expCompEnd; i++) {
-		ExponencialComplexa(Phi(i), &Xs(i));	
-		//Xs(i) = ExponencialComplexa(Phi(i));	
-	}
-
-	//Sinthesis: //t2-t3 -> //t1-t2: t3 = getticks();
+	if (synthesis == PHASE_LOCKED_SYNTHESIS)
+		npeaks = peaks(Xa_abs[0].memptr(), bins, peak);
 
-	Xs = Xa_abs[0] % Xs;
-	PhiPrevious = Phi;
-	
-	//Sinthesis: //t2-t3 -> //t1-t2: t4 = getticks();
-	//step 2, t2
+	//Phase reset: at an onset, or when the frame size changes, the phases start over from the analysis
+	bool reset = analysis->reset;
+	bool locked = !reset && synthesis == PHASE_LOCKED_SYNTHESIS && npeaks > 0;
 
-	for (int i=0; i<(N/2 + 1); i++)
+	if (locked)
 	{
-	    fXs[i][0] = real(Xs(i));
-	    fXs[i][1] = imag(Xs(i));
+		//Identity phase locking: only the peaks are advanced, the bins around each peak keep
+		//their analysed phase relation to it, which removes most of the phasiness
+		peak_regions(Xa_abs[0].memptr(), peak, npeaks, region);
+
+		for (int k=0; k<npeaks; k++)
+		{
+			int pk = peak[k];
+			int start = region[k];
+			int end = (k < npeaks-1) ? region[k+1] : bins;
+			uint32_t phi_pk = Phi[pk] + ToPhase((hops[Qcolumn-1])*omega_true_sobre_fs[0](pk));
+			uint32_t arg_pk = Xa_arg[pk];
+
+			for (int i=start; i<end; i++)
+				Phi[i] = phi_pk + (Xa_arg[i] - arg_pk);
+		}
 	}
 
-	//step 2, t3
-
-	//Sinthesis, t3
-
-	/*Synthesis*/
-	if (p2) fftwf_execute(p2);
-
-	//Sinthesis, t4
+	//Sinthesis: //t2-t3 -> //t1-t2: t2 = getticks();
 	
-	double norm = N*sqrt( N/(2.0*hops[Qcolumn-1]) );
+	//The phases of the other modes and the spectrum are per bin, the pool may split them across threads
+	const double *omega = omega_true_sobre_fs[0].memptr();
+	const double *mag = Xa_abs[0].memptr();
+	fftwf_plan plan = (Na == N) ? p2 : p2short;
+	double scale = 1/(K*Na*sqrt( Ew/hops[Qcolumn-1] ));
 
-	for (int i=0; i<N; i++)
-		q[i] = q[i]*w[0](i)/norm;
-	
 	if (first)
 	{
 		first = false;
-		memset(ysaida,0,sizeof(double)*(L-N));
-		for (int i=L-N; i<L; i++)
-			ysaida[i] = q[i-(L-N)];
+		memset(ysaida,0,sizeof(float)*L);
 	}
-	else
+
+	for (int k=0; k<K; k++)
 	{
-		for (int i=L-N; i<L; i++)
-			ysaida[i] = ysaida[i] + q[i-(L-N)];
+		double advance = k*sub;
+
+		SplitBins(pool, bins, [&](int start, int end)
+		{
+			if (k > 0)
+			{
+				for (int i=start; i<end; i++)
+				{
+					float re, im;
+					ExponencialComplexa(Phi[i] + ToPhase(advance*omega[i]), &re, &im);
+					fXs[i][0] = mag[i]*re;
+					fXs[i][1] = mag[i]*im;
+				}
+				return;
+			}
+
+			if (reset)
+			{
+				for (int i=start; i<end; i++)
+					Phi[i] = Xa_arg[i];
+			}
+			else if (!locked)
+			{
+				for (int i=start; i<end; i++)
+					Phi[i] = Phi[i] + ToPhase(hop*omega[i]);
+			}
+
+			SpectrumBins(Phi, mag, fXs, start, end);
+		});
+
+		//Sinthesis, t3
+
+		/*Synthesis*/
+		if (plan) fftwf_execute(plan);
+
+		//Sinthesis, t4
+
+		if (Na == N)
+		{
+			const double *win = w[0].memptr();
+			for (int i=0; i<N; i++)
+				q[i] = q[i]*win[i]*scale;
+		}
+		else
+		{
+			//A short frame already carries the product window, a Hann of Ns samples, and goes in at the end of the frame
+			for (int i=0; i<Na; i++)
+				q[i] = q[i]*scale;
+		}
+
+		//Overlap-add of the frame delayed by fk samples (linear interpolation between neighbours of q)
+		double Pk = P + advance;
+		int Pik = (int)Pk;
+		double fk = Pk - Pik;
+		float *y = &ysaida[Pik] + (N - Na);
+		y[0] = y[0] + (1-fk)*q[0];
+		for (int i=1; i<Na; i++)
+			y[i] = y[i] + (1-fk)*q[i] + fk*q[i-1];
+		y[Na] = y[Na] + fk*q[Na-1];
 	}
 
 	//Sinthesis, t5
-	//Linear interpolation
+	//Resampling, starting where the synthesis window of the newest frame begins. The read is moved back by
+	//the taps the resampler needs past the last position, which only reach samples that are already complete
 	r = hops[Qcolumn-1]/(1.0*hopa);
-
-        for (int n=0; n < hopa; n++)
-        {
-		n3 = n*r+1;
-		n1 = floor(n3);
-		n2 = ceil(n3);
-		yshift[n] = ysaida2[n1] + (ysaida2[n2]-ysaida2[n1])*(n3 - n1);
-	}
+	resampler->Process(ysaida2, f + (N - Ns) - (resampler->Reach() - 1), r, hopa, yshift);
 
 	//Sinthesis, t6
 	
-	//Shift ysaida hops[0] left
-	for (int i=0; i<L-hops[0]; i++)
-		ysaida[i] = ysaida[i+hops[0]];
-	for (int i=L-hops[0]; i<L; i++)
+	//Shift ysaida hops[0] left, the fractional remainder is carried in frac
+	double S = frac + hops[0];
+	int Si = (int)S;
+	frac = S - Si;
+	for (int i=0; i<L-Si; i++)
+		ysaida[i] = ysaida[i+Si];
+	for (int i=L-Si; i<L; i++)
 		ysaida[i] = 0;
 
 	//Sinthesis, t7
@@ -296,22 +424,14 @@ void PSSinthesis::Sinthesis(double s)
 	
 }
 
-int nBuffersSW(uint32_t n_samples, int c64, int c128, int c256, int c_default)
+int nBuffersMs(uint32_t n_samples, double samplerate, double frame_ms)
 {
-	switch(n_samples)
-	{
-		case 64:
-			return c64;
-		case 128:
-			return c128;
-		case 256:
-			return c256;
-		default:
-			return c_default;
-	}
+	//Number of hops of n_samples that best fit a frame of frame_ms, at least two for the overlap-add
+	long n = lround(frame_ms*samplerate/(1000.0*n_samples));
+	return (n < 2) ? 2 : (int)n;
 }
 
-float InputAbsSum(float *in, uint32_t n_samples)
+float InputAbsSum(const float *in, uint32_t n_samples)
 {
 	/* needs performance testing first. should be worth it by a tiny margin.. */
 #if 0 //def __ARM_NEON__
@@ -4,77 +4,151 @@
 #include <complex>
 #include <fftw3.h>
 #include <armadillo>
-#include "Exp.h"
+#include "phase.h"
 #include "angle.h"
 #include "window.h"
+#include "peaks.h"
+#include "OscillatorBank.h"
+#include "Resampler.h"
+#include "planner.h"
+#include "Arena.h"
+#include "BinPool.h"
 #include <lv2/lv2plug.in/ns/lv2core/lv2.h>
 
 using namespace arma;
 using namespace std;
 
+enum {STANDARD_SYNTHESIS, PHASE_LOCKED_SYNTHESIS, SINUSOIDAL_SYNTHESIS};
+
+#define ONSET_HOPS 8 //Hops of input energy the newest one is compared to
+#define ONSET_RATIO 8.0 //Energy jump, about 9 dB, that marks an onset
+#define ONSET_FLOOR 1e-5 //Mean square below which nothing is an onset, -50 dBFS
+
+//Per-bin loops of Analysis() and Sinthesis(). They are inline so tools/bench.cpp can also build them with the sizes
+//known when compiling, and time that against the sizes only known at run time, as the engine has them
+
+//Modulus, phase and true frequency of the bins start to end of a frame of Na samples, analysed every hopa samples.
+//track is 1/hopa, or 0 to give the bin centres when the previous phases in arg belong to another frame size
+inline void UnwrapBins(const fftwf_complex *X, uint32_t *arg, double *mag, double *omega, int start, int end, int Na, int hopa, double track)
+{
+	const double bin = 2*M_PI/Na;
+	const uint32_t expected = (uint32_t)(((uint64_t)hopa << 32)/Na); //Advance of bin 1 over a hop
+	uint32_t advance = expected*(uint32_t)start;
+
+	for (int i=start; i<end; i++)
+	{
+		double re = X[i][0];
+		double im = X[i][1];
+		double a;
+		angle(complex<double>(re, im), &a);
+		uint32_t phase = ToPhase(a);
+
+		int32_t d = (int32_t)(phase - arg[i] - advance);
+
+		omega[i] = bin*i + track*PhaseToRadians(d);
+		mag[i] = sqrt(re*re + im*im);
+		arg[i] = phase;
+		advance = advance + expected;
+	}
+}
+
+//Spectrum of the bins start to end from their phases and moduli
+inline void SpectrumBins(const uint32_t *phi, const double *mag, fftwf_complex *X, int start, int end)
+{
+	for (int i=start; i<end; i++)
+	{
+		float re, im;
+		ExponencialComplexa(phi[i], &re, &im);
+		X[i][0] = mag[i]*re;
+		X[i][1] = mag[i]*im;
+	}
+}
+
 class PSAnalysis
 {
 public:
-    PSAnalysis(uint32_t n_samples, int nBuffers, const char* wisdomFile);
+    PSAnalysis(uint32_t n_samples, int nBuffers, int window, Arena *arena, const char* wisdomFile);
     ~PSAnalysis();
+    static size_t ArenaSize(uint32_t n_samples, int nBuffers, int window);
     void PreAnalysis(int nBuffers, float *in);
-    void Analysis();
+    void Analysis(BinPool *pool);
+    void DetectOnset();
 
     int N; //Size of the frame
     int hopa; //Analysis hop
     int Qcolumn; //Number of frames that may be used in the overlap-add
+    int window; //HANN_WINDOW or ASYMMETRIC_WINDOW
+    int Ns; //Support of the synthesis window, the last Ns samples of the frame
+    int Nc; //Distance from the centroid of the analysis window to the end of the frame
+    double Ew; //Window energy used to normalize the overlap-add
+    double Wsum; //Sum of the analysis window
+
+    bool transients; //Whether onsets are detected
+    double energy[ONSET_HOPS]; //Energy of the last hops of the input
+    int hold; //Hops left until the long frame no longer contains the last onset
+    int Na; //Size of the frame analysed in this hop, N or Ns for a short frame
+    bool resized; //Na changed in this hop
+    bool reset; //The synthesis phases restart from the analysis in this hop, at onsets and frame size changes
 
-    double **b;
-    
-    double *frames; //A frame of last N samples
-    vec w; //A hanning window vector
+    double *frames; //A frame of last N samples, the FRAME_HISTORY samples before it are kept too
+    vec w; //The analysis window
+    double *wshort; //Analysis window of the short frames, a Hann of Ns samples
     float *frames2; //It's the frames vector windowed
     fftwf_plan p; //FFTW plan for the FFT of frames2
+    fftwf_plan pshort; //FFTW plan for the FFT of a short frame in frames2
     fftwf_complex *fXa; // FFT of frames2
-    cx_vec Xa; // Armadillo vector of fXa
-    vec Xa_arg; //Phase of Xa
-    vec Xa_abs; //Modulus of Xa
-    cx_vec XaPrevious;
-    vec XaPrevious_arg;
-    vec d_phi; //Xa_arg - XaPrevious
-	vec d_phi_prime; //?
-	vec I; // A vector of the N/2 integer numbers, starting from 0.
-	vec AUX; //?
-	vec d_phi_wrapped; //?
-	vec omega_true_sobre_fs; //?
+    uint32_t *Xa_arg; //Phase of fXa, the previous frame's until Analysis runs
+    vec Xa_abs; //Modulus of fXa
+	vec omega_true_sobre_fs; //True frequency of each bin in radians per sample
+    vec ws; //The synthesis window
 };
 
 class PSSinthesis
 {
 public:
-    PSSinthesis(PSAnalysis *obj, const char* wisdomFile);
+    PSSinthesis(PSAnalysis *obj, Arena *arena, const char* wisdomFile);
     ~PSSinthesis();
+    static size_t ArenaSize(uint32_t n_samples, int nBuffers);
     void PreSinthesis();
-    void Sinthesis(double s);
+    void Sinthesis(double s, BinPool *pool);
     void ClearYShift();
     void ClearBuffers();
     void SetYShiftFromInput(const float* in, int n);
+    void SetSynthesis(int mode);
+    int Delay();
 
     int N; //Size of the frame
     int hopa; //Analysis hop
     int Qcolumn; //Number of frames that may be used in the overlap-add
     vec *omega_true_sobre_fs; //?
     vec *Xa_abs; //Modulus of Xa
-    vec *w; //A hanning window vector
+    uint32_t *Xa_arg; //Phase of Xa
+    vec *w; //The synthesis window
+    PSAnalysis *analysis; //Frame size and phase reset of the current hop
+    int Ns; //Support of the synthesis window
+    int Nc; //Distance from the centroid of the analysis window to the end of the frame
+    double Ew; //Window energy used to normalize the overlap-add
+    double Wsum; //Sum of the analysis window
 
     bool first;
-    int *hops; //The last Qcolumn's hop's used in the overlap-add
-    vec Phi; //The synthesized phase
-	vec PhiPrevious;
-	cx_vec Xs; //The synthesized spectrum, with modulus Xa_abs and phase Phi
-	fftwf_complex *fXs; //fftw version of Xs
+    int synthesis; //STANDARD_SYNTHESIS, PHASE_LOCKED_SYNTHESIS or SINUSOIDAL_SYNTHESIS
+    int npeaks; //Number of spectral peaks found in the current frame
+    int *peak; //Bins of the spectral peaks
+    int *region; //First bin of the region of influence of each peak
+    OscillatorBank *bank; //Partial tracks of the sinusoidal synthesis
+    double *hops; //The last Qcolumn's hop's used in the overlap-add
+    double frac; //Fractional position of the first element of ysaida
+    uint32_t *Phi; //The synthesized phase, advanced in place every hop
+	fftwf_complex *fXs; //The synthesized spectrum, with modulus Xa_abs and phase Phi
 	fftwf_plan p2; //FFTW plan for the IFFT of fXs
+	fftwf_plan p2short; //FFTW plan for the IFFT of a short frame
 	float *q; //windowed IFFT of fXs
-	double *ysaida; //Overlap-add vector (time-stretched signal)
-	double *ysaida2; //Pointer that points to the elemente that is equivalent to the first element of frames
+	float *ysaida; //Overlap-add vector (time-stretched signal)
+	float *ysaida2; //Pointer that points to the elemente that is equivalent to the first element of frames
 	double *yshift; //The first hops[Qcolumn] elemements of ysaida2 resampled to hopa elements   
+	Resampler *resampler; //Resamples ysaida2 to yshift
 };
 
-int nBuffersSW(uint32_t n_samples, int c64, int c128, int c256, int c_default);
-float InputAbsSum(float *in, uint32_t n_samples);
+int nBuffersMs(uint32_t n_samples, double samplerate, double frame_ms);
+float InputAbsSum(const float *in, uint32_t n_samples);
 uint32_t GetBufferSize(const LV2_Feature* const* features);
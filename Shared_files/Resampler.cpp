@@ -0,0 +1,170 @@
+#include <cmath>
+#include <cstring>
+#include "Resampler.h"
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#define SINC_ROW (SINC_TAPS)
+#define SINC_KERNEL ((SINC_PHASES + 1)*SINC_TAPS)
+
+/*
+Blackman windowed sinc kernels. Row p of kernel c holds the taps for a read position p/SINC_PHASES past an input
+sample, tap t weighting the sample t - (SINC_TAPS/2 - 1) away from it. Every row is normalized to unit DC gain.
+*/
+static float *BuildTable()
+{
+	void *mem = NULL;
+	if (posix_memalign(&mem, 64, sizeof(float)*SINC_CUTOFFS*SINC_KERNEL) != 0)
+		return NULL;
+	float *t = (float*)mem;
+	const double half = SINC_TAPS/2;
+
+	for (int c=0; c<SINC_CUTOFFS; c++)
+	{
+		double fc = pow(2, -c/4.0);
+		for (int p=0; p<=SINC_PHASES; p++)
+		{
+			float *row = &t[c*SINC_KERNEL + p*SINC_ROW];
+			double sum = 0;
+			for (int k=0; k<SINC_TAPS; k++)
+			{
+				double d = k - (half - 1) - p/(double)SINC_PHASES;
+				double u = d/half;
+				double w = (fabs(u) >= 1) ? 0 : 0.42 + 0.5*cos(M_PI*u) + 0.08*cos(2*M_PI*u);
+				double x = M_PI*fc*d;
+				double s = (fabs(x) < 1e-12) ? fc : fc*sin(x)/x;
+				row[k] = s*w;
+				sum += s*w;
+			}
+			for (int k=0; k<SINC_TAPS; k++)
+				row[k] = row[k]/sum;
+		}
+	}
+
+	return t;
+}
+
+Resampler::Resampler() //Constructor
+{
+	//Built once for the whole process, function local statics are initialized thread safely
+	static const float *shared = BuildTable();
+	table = shared;
+	quality = LINEAR_INTERPOLATION;
+}
+
+//Input samples needed before the first read position
+int Resampler::Delay()
+{
+	switch (quality)
+	{
+		case CUBIC_INTERPOLATION:
+			return 1;
+		case SINC_INTERPOLATION:
+			return SINC_TAPS/2 - 1;
+		default:
+			return 0;
+	}
+}
+
+//Input samples needed after the last read position
+int Resampler::Reach()
+{
+	switch (quality)
+	{
+		case CUBIC_INTERPOLATION:
+			return 2;
+		case SINC_INTERPOLATION:
+			return SINC_TAPS/2;
+		default:
+			return 1;
+	}
+}
+
+static inline float Dot(const float *a, const float *b, const float *x, float mu)
+{
+#if defined(__SSE__)
+	__m128 m = _mm_set1_ps(mu);
+	__m128 acc = _mm_setzero_ps();
+	for (int k=0; k<SINC_TAPS; k+=4)
+	{
+		__m128 ca = _mm_load_ps(&a[k]);
+		__m128 c = _mm_add_ps(ca, _mm_mul_ps(m, _mm_sub_ps(_mm_load_ps(&b[k]), ca)));
+		acc = _mm_add_ps(acc, _mm_mul_ps(c, _mm_loadu_ps(&x[k])));
+	}
+	float sum[4];
+	_mm_storeu_ps(sum, acc);
+	return sum[0] + sum[1] + sum[2] + sum[3];
+#elif defined(__ARM_NEON__)
+	float32x4_t acc = vdupq_n_f32(0.0f);
+	for (int k=0; k<SINC_TAPS; k+=4)
+	{
+		float32x4_t ca = vld1q_f32(&a[k]);
+		float32x4_t c = vmlaq_n_f32(ca, vsubq_f32(vld1q_f32(&b[k]), ca), mu);
+		acc = vmlaq_f32(acc, c, vld1q_f32(&x[k]));
+	}
+	float sum[4];
+	vst1q_f32(sum, acc);
+	return sum[0] + sum[1] + sum[2] + sum[3];
+#else
+	float acc = 0;
+	for (int k=0; k<SINC_TAPS; k++)
+		acc += (a[k] + mu*(b[k] - a[k]))*x[k];
+	return acc;
+#endif
+}
+
+/*
+Writes n samples read from in at start, start+ratio, start+2*ratio... The caller has to provide Delay() samples
+before start and Reach() samples after the last position. Positions may be negative, in counts from in backwards.
+*/
+void Resampler::Process(const float *in, double start, double ratio, int n, double *out)
+{
+	switch (quality)
+	{
+		case CUBIC_INTERPOLATION:
+			//4-point Catmull-Rom
+			for (int i=0; i<n; i++)
+			{
+				double x = start + i*ratio;
+				int j = (int)floor(x);
+				float t = x - j;
+				float ym = in[j-1], y0 = in[j], y1 = in[j+1], y2 = in[j+2];
+				float c1 = 0.5f*(y1 - ym);
+				float c2 = ym - 2.5f*y0 + 2.0f*y1 - 0.5f*y2;
+				float c3 = 0.5f*(y2 - ym) + 1.5f*(y0 - y1);
+				out[i] = ((c3*t + c2)*t + c1)*t + y0;
+			}
+			break;
+
+		case SINC_INTERPOLATION:
+		{
+			//Downsampling (shifting up) needs the cutoff lowered below the output Nyquist to avoid aliasing
+			int c = (ratio > 1) ? (int)ceil(4*log2(ratio) - 1e-9) : 0;
+			if (c > SINC_CUTOFFS-1)
+				c = SINC_CUTOFFS-1;
+			const float *kernel = &table[c*SINC_KERNEL];
+
+			for (int i=0; i<n; i++)
+			{
+				double x = start + i*ratio;
+				int j = (int)floor(x);
+				float ph = (x - j)*SINC_PHASES;
+				int p = (int)ph;
+				out[i] = Dot(&kernel[p*SINC_ROW], &kernel[(p+1)*SINC_ROW], &in[j - (SINC_TAPS/2 - 1)], ph - p);
+			}
+			break;
+		}
+
+		default:
+			for (int i=0; i<n; i++)
+			{
+				double x = start + i*ratio;
+				int j = (int)floor(x);
+				out[i] = in[j] + (in[j+1] - in[j])*(x - j);
+			}
+			break;
+	}
+}
@@ -0,0 +1,20 @@
+#include <stdlib.h>
+#include <stdint.h>
+
+#define SINC_TAPS 16 //Taps of the windowed-sinc kernel
+#define SINC_PHASES 128 //Fractional positions tabulated per kernel, interpolated in between
+#define SINC_CUTOFFS 9 //Kernels with cutoffs from Nyquist down to a quarter of it in 1/4 octave steps
+
+enum {LINEAR_INTERPOLATION, CUBIC_INTERPOLATION, SINC_INTERPOLATION};
+
+class Resampler
+{
+public:
+	Resampler();
+	void Process(const float *in, double start, double ratio, int n, double *out);
+	int Delay();
+	int Reach();
+
+	int quality; //LINEAR_INTERPOLATION, CUBIC_INTERPOLATION or SINC_INTERPOLATION
+	const float *table; //SINC_CUTOFFS kernels of SINC_PHASES+1 rows of SINC_TAPS coefficients, shared by all instances
+};
@@ -0,0 +1,36 @@
+#include <complex>
+#include <cmath>
+#include "peaks.h"
+
+//Local maxima of the n bins of mag, returns how many were written to target
+int peaks(const double *mag, int n, int *target)
+{
+	int count = 0;
+
+	for (int i=1; i<n-1; i++)
+	{
+		double m = mag[i];
+		if (m > mag[i-1] && m >= mag[i+1])
+			target[count++] = i;
+	}
+
+	return count;
+}
+
+//For each peak, the first bin of its region of influence: regions are split at the lowest bin between two peaks
+void peak_regions(const double *mag, const int *peaks, int npeaks, int *target)
+{
+	if (npeaks == 0)
+		return;
+
+	target[0] = 0;
+
+	for (int k=1; k<npeaks; k++)
+	{
+		int lowest = peaks[k-1] + 1;
+		for (int i=lowest+1; i<peaks[k]; i++)
+			if (mag[i] < mag[lowest])
+				lowest = i;
+		target[k] = lowest;
+	}
+}
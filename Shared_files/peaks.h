@@ -0,0 +1,8 @@
+#include <complex>
+#include <cmath>
+
+using namespace std;
+
+int peaks(const double *mag, int n, int *target);
+void peak_regions(const double *mag, const int *peaks, int npeaks, int *target);
+
@@ -0,0 +1,13 @@
+#include "phase.h"
+
+float sin_table[SIN_TABLE_SIZE + 1];
+
+static bool FillSinTable()
+{
+	for (int i=0; i<=SIN_TABLE_SIZE; i++)
+		sin_table[i] = (float)sin(2*M_PI*i/SIN_TABLE_SIZE);
+	return true;
+}
+
+//Filled when the plugin is loaded, before any instance exists
+static bool filled = FillSinTable();
@@ -0,0 +1,47 @@
+#include <mutex>
+#include "planner.h"
+
+static std::mutex planner_mutex;
+static std::once_flag wisdom_flag;
+static bool wisdom = false;
+
+// Imported once per process, the first instance decides which wisdom is used. Without any the plans are estimated
+static void import_wisdom(const char* wisdomFile)
+{
+	wisdom = fftwf_import_system_wisdom() != 0 || fftwf_import_wisdom_from_filename(wisdomFile) != 0;
+}
+
+fftwf_plan plan_r2c(int n, float *in, fftwf_complex *out, const char* wisdomFile)
+{
+	std::lock_guard<std::mutex> lock(planner_mutex);
+	std::call_once(wisdom_flag, import_wisdom, wisdomFile);
+
+	fftwf_plan p = NULL;
+	if (wisdom)
+		p = fftwf_plan_dft_r2c_1d(n, in, out, FFTW_WISDOM_ONLY|FFTW_ESTIMATE);
+	//The wisdom only covers the frame sizes used at 44.1/48 kHz
+	if (!p)
+		p = fftwf_plan_dft_r2c_1d(n, in, out, FFTW_ESTIMATE);
+	return p;
+}
+
+fftwf_plan plan_c2r(int n, fftwf_complex *in, float *out, const char* wisdomFile)
+{
+	std::lock_guard<std::mutex> lock(planner_mutex);
+	std::call_once(wisdom_flag, import_wisdom, wisdomFile);
+
+	fftwf_plan p = NULL;
+	if (wisdom)
+		p = fftwf_plan_dft_c2r_1d(n, in, out, FFTW_WISDOM_ONLY|FFTW_ESTIMATE);
+	if (!p)
+		p = fftwf_plan_dft_c2r_1d(n, in, out, FFTW_ESTIMATE);
+	return p;
+}
+
+void destroy_plan(fftwf_plan p)
+{
+	if (!p)
+		return;
+	std::lock_guard<std::mutex> lock(planner_mutex);
+	fftwf_destroy_plan(p);
+}
@@ -0,0 +1,7 @@
+#include <fftw3.h>
+
+// The FFTW planner and its wisdom are process-wide and not thread safe, hosts may instantiate
+// or reconfigure several plugins at once so every plan is created and destroyed through here
+fftwf_plan plan_r2c(int n, float *in, fftwf_complex *out, const char* wisdomFile);
+fftwf_plan plan_c2r(int n, fftwf_complex *in, float *out, const char* wisdomFile);
+void destroy_plan(fftwf_plan p);
@@ -12,3 +12,33 @@ void hann(int n, vec *w)
 	I = 0.5*(1-cos(2*M_PI*I/(n-1)));
 	w[0] = I;
 }
+
+static double periodic_hann(int n, int l)
+{
+	return 0.5*(1 - cos(2*M_PI*n/l));
+}
+
+/*
+Asymmetric analysis/synthesis pair for a frame of n samples. The analysis window rises over the
+first n-m samples and falls over the last m; the synthesis window is zero except on the last 2m
+samples, where the product of the two is a periodic Hann of length 2m. The overlap-add therefore
+only has to wait for 2m samples instead of n.
+*/
+void asymmetric(int n, int m, vec *wa, vec *ws)
+{
+	wa[0].zeros(n);
+	ws[0].zeros(n);
+
+	for (int i=0; i<n-m; i++)
+		wa[0](i) = sqrt(periodic_hann(i, 2*(n-m)));
+	for (int i=n-m; i<n; i++)
+		wa[0](i) = sqrt(periodic_hann(i-(n-2*m), 2*m));
+
+	for (int i=n-2*m; i<n-m; i++)
+	{
+		double den = wa[0](i);
+		ws[0](i) = (den > 1e-9) ? periodic_hann(i-(n-2*m), 2*m)/den : 0;
+	}
+	for (int i=n-m; i<n; i++)
+		ws[0](i) = wa[0](i);
+}
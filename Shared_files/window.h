@@ -4,5 +4,9 @@
 
 using namespace arma;
 using namespace std;
+
+enum {HANN_WINDOW, ASYMMETRIC_WINDOW};
+
 void hann(int n, vec *w);
+void asymmetric(int n, int m, vec *wa, vec *ws);
 